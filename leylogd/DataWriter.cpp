@@ -0,0 +1,418 @@
+//============================================================================
+// Name        	: DataWriter.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.4
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Crash-consistent record file definition file
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+
+#include "DataWriter.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+/****** CRC-32 (IEEE 802.3, reflected) ******/
+/* Filled in by a static constructor, before main() and therefore before any
+ * thread (leylogd-replay's workers, the sampling thread) can use it */
+static uint32_t crcTable[256];
+
+static struct crcTableInit {
+	crcTableInit(){
+		for (uint32_t n = 0; n < 256; n++){
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			crcTable[n] = c;
+		}
+	}
+} crcTableReady;
+
+uint32_t crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	crc = ~crc;
+	while (len--)
+		crc = crcTable[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static uint32_t recordCrc(const DataRecordHeader *hdr, const void *payload)
+{
+	/* type, reserved and length are contiguous in the header */
+	uint32_t crc = crc32(0, &hdr->type, sizeof(hdr->type) + sizeof(hdr->reserved) + sizeof(hdr->length));
+	return crc32(crc, payload, hdr->length);
+}
+
+static long elapsedMsec(const struct timespec *since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec)*1000 + (now.tv_nsec - since->tv_nsec)/1000000;
+}
+
+DataWriter::DataWriter(){
+	// Constructor
+	fd = -1;
+	checkpointFd = -1;
+	fileSize = 0;
+	allocatedEnd = 0;
+	preallocBytes = 0;
+	pendingRecords = 0;
+	records = 0;
+	lastRecord = -1;
+	lastCrc = 0;
+	syncRecords = 1;
+	syncMsec = 0;
+	lastSync.tv_sec = 0;
+	lastSync.tv_nsec = 0;
+}
+
+int DataWriter::open(const char *filename, int syncRecords, int syncMsec, int preallocKb){
+	if ((fd = ::open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)) < 0){
+		logMessage("DataWriter: Failed to open %s (%s)",filename,strerror(errno));
+		return(-1);
+	}
+	char checkpointName[PATH_MAX];
+	snprintf(checkpointName, sizeof(checkpointName), "%s.ckpt", filename);
+	if ((checkpointFd = ::open(checkpointName, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)) < 0)
+		logMessage("DataWriter: No checkpoint, %s will be scanned in full on every open (%s)",
+				checkpointName,strerror(errno));
+	/* Without a checkpoint nothing is known to be torn, so only a bad tail
+	 * is cut; corrupt records before it are skipped */
+	off_t from = checkpointedEnd();
+	struct stat sb;
+	off_t resyncBefore = (from == 0 && fstat(fd, &sb) == 0) ? sb.st_size : from;
+	if ((fileSize = recover(fd, from, resyncBefore, &records, &lastRecord, &lastCrc)) < 0){
+		::close(fd);
+		fd = -1;
+		fileSize = 0;
+		close();
+		return(-1);
+	}
+	if (fileSize != from && fdatasync(fd) == 0)
+		writeCheckpoint();	/* So the next open starts here */
+	allocatedEnd = fileSize;
+	preallocBytes = (off_t)preallocKb*1024;
+	setSyncPolicy(syncRecords, syncMsec);
+	clock_gettime(CLOCK_MONOTONIC, &lastSync);
+	logMessage("DataWriter: Opened %s (%u records, %ld bytes, %ld scanned)",
+			filename,records,(long)fileSize,(long)(fileSize - from));
+	return(0);
+}
+
+void DataWriter::setSyncPolicy(int syncRecords, int syncMsec){
+	this->syncRecords = (syncRecords > 0) ? syncRecords : 1;
+	this->syncMsec = (syncMsec > 0) ? syncMsec : 0;
+}
+
+int DataWriter::preallocate(off_t need){
+	if (preallocBytes == 0 || need <= allocatedEnd)
+		return(0);
+	/* FALLOC_FL_KEEP_SIZE: reserve extents without moving EOF, so the file
+	 * size always marks the end of the last record written. */
+	off_t len = preallocBytes;
+	while (allocatedEnd + len < need)
+		len += preallocBytes;
+	if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocatedEnd, len) == -1){
+		if (errno == EOPNOTSUPP || errno == ENOSYS){
+			logMessage("DataWriter: fallocate unsupported, preallocation disabled");
+			preallocBytes = 0;
+			return(0);
+		}
+		logMessage("DataWriter: fallocate failed (%s)",strerror(errno));
+		return(-1);
+	}
+	allocatedEnd += len;
+	return(0);
+}
+
+int DataWriter::append(DW_RECORD_TYPE type, const void *payload, uint32_t length){
+	if (fd < 0)
+		return(-1);
+	if (length > DW_MAX_PAYLOAD){
+		logMessage("DataWriter: Record of %u bytes exceeds %d",length,DW_MAX_PAYLOAD);
+		return(-1);
+	}
+	char record[sizeof(DataRecordHeader) + DW_MAX_PAYLOAD];
+	DataRecordHeader *hdr = (DataRecordHeader *)record;
+	hdr->magic = DW_RECORD_MAGIC;
+	hdr->type = type;
+	hdr->reserved = 0;
+	hdr->length = length;
+	hdr->crc = recordCrc(hdr, payload);
+	memcpy(record + sizeof(DataRecordHeader), payload, length);
+
+	size_t total = sizeof(DataRecordHeader) + length;
+	preallocate(fileSize + total);
+	ssize_t written = pwrite(fd, record, total, fileSize);
+	if (written != (ssize_t)total){
+		/* Leave fileSize alone; the next append overwrites the partial record */
+		logMessage("DataWriter: Short record write (%ld of %lu)",(long)written,(unsigned long)total);
+		return(-1);
+	}
+	lastRecord = fileSize;
+	lastCrc = hdr->crc;
+	fileSize += total;
+	pendingRecords++;
+	records++;
+	return(syncIfDue());
+}
+
+int DataWriter::syncIfDue(){
+	if (pendingRecords == 0)
+		return(0);
+	if (pendingRecords >= (unsigned)syncRecords || (syncMsec > 0 && elapsedMsec(&lastSync) >= syncMsec))
+		return(sync());
+	return(0);
+}
+
+/* The event loop sleeps at most this long, so pending records are synced
+ * within syncMsec even when no further append() comes to check */
+long DataWriter::msecUntilSync(){
+	if (fd < 0 || pendingRecords == 0 || syncMsec == 0)
+		return(-1);
+	long wait = syncMsec - elapsedMsec(&lastSync);
+	return((wait < 0) ? 0 : wait);
+}
+
+int DataWriter::sync(){
+	if (fd < 0 || pendingRecords == 0)
+		return(0);
+	if (fdatasync(fd) == -1){
+		logMessage("DataWriter: fdatasync failed (%s)",strerror(errno));
+		return(-1);
+	}
+	pendingRecords = 0;
+	clock_gettime(CLOCK_MONOTONIC, &lastSync);
+	writeCheckpoint();
+	return(0);
+}
+
+/* Everything before fileSize is on disk now. The checkpoint itself isn't
+ * synced: a stale one only means scanning a little more on the next open. */
+void DataWriter::writeCheckpoint(){
+	if (checkpointFd < 0)
+		return;
+	struct DataCheckpoint ckpt;
+	memset(&ckpt, 0, sizeof(ckpt));
+	ckpt.magic = DW_CHECKPOINT_MAGIC;
+	ckpt.records = records;
+	ckpt.offset = fileSize;
+	ckpt.lastRecord = (lastRecord < 0) ? 0 : lastRecord;
+	ckpt.lastCrc = lastCrc;
+	ckpt.crc = crc32(0, &ckpt, offsetof(struct DataCheckpoint, crc));
+	if (pwrite(checkpointFd, &ckpt, sizeof(ckpt), 0) != (ssize_t)sizeof(ckpt))
+		logMessage("DataWriter: Failed to write checkpoint (%s)",strerror(errno));
+}
+
+/* Where recovery may start: the checkpointed end if the record it names is
+ * still in place, otherwise 0 (records, lastRecord and lastCrc follow) */
+off_t DataWriter::checkpointedEnd(){
+	struct DataCheckpoint ckpt;
+	DataRecordHeader hdr;
+	struct stat sb;
+
+	records = 0;
+	lastRecord = -1;
+	lastCrc = 0;
+	if (checkpointFd < 0 || fstat(fd, &sb) == -1)
+		return(0);
+	if (pread(checkpointFd, &ckpt, sizeof(ckpt), 0) != (ssize_t)sizeof(ckpt)
+			|| ckpt.magic != DW_CHECKPOINT_MAGIC
+			|| ckpt.crc != crc32(0, &ckpt, offsetof(struct DataCheckpoint, crc))
+			|| ckpt.offset == 0 || (off_t)ckpt.offset > sb.st_size)
+		return(0);
+	if (pread(fd, &hdr, sizeof(hdr), ckpt.lastRecord) != (ssize_t)sizeof(hdr)
+			|| hdr.magic != DW_RECORD_MAGIC || hdr.crc != ckpt.lastCrc
+			|| ckpt.lastRecord + sizeof(hdr) + hdr.length != ckpt.offset){
+		logMessage("DataWriter: Checkpoint doesn't match the file, scanning it all");
+		return(0);
+	}
+	records = ckpt.records;
+	lastRecord = ckpt.lastRecord;
+	lastCrc = ckpt.lastCrc;
+	return(ckpt.offset);
+}
+
+/* Discard every record, e.g. once a spool has been replayed */
+int DataWriter::truncate(){
+	if (fd < 0)
+		return(-1);
+	if (ftruncate(fd, 0) == -1){
+		logMessage("DataWriter: ftruncate failed (%s)",strerror(errno));
+		return(-1);
+	}
+	fileSize = 0;
+	allocatedEnd = 0;
+	records = 0;
+	lastRecord = -1;
+	lastCrc = 0;
+	pendingRecords = 1;	/* Make sync() commit the new size */
+	return(sync());
+}
+
+void DataWriter::close(){
+	if (checkpointFd >= 0 && fd < 0){
+		::close(checkpointFd);	/* open() failed part way */
+		checkpointFd = -1;
+	}
+	if (fd < 0)
+		return;
+	sync();
+	/* Hand back any unused preallocation past the last record */
+	if (allocatedEnd > fileSize)
+		ftruncate(fd, fileSize);
+	::close(fd);
+	fd = -1;
+	if (checkpointFd >= 0)
+		::close(checkpointFd);
+	checkpointFd = -1;
+}
+
+/* Returns 1 and fills hdr/payload for a valid record, 0 at a clean end of
+ * file and -1 for a torn or corrupt record. */
+int DataWriter::readRecord(int fd, off_t offset, DataRecordHeader *hdr,
+		void *payload, uint32_t maxPayload){
+	ssize_t n = pread(fd, hdr, sizeof(DataRecordHeader), offset);
+	if (n == 0)
+		return(0);
+	if (n != (ssize_t)sizeof(DataRecordHeader) || hdr->magic != DW_RECORD_MAGIC
+			|| hdr->length > maxPayload)
+		return(-1);
+	if (pread(fd, payload, hdr->length, offset + sizeof(DataRecordHeader)) != (ssize_t)hdr->length)
+		return(-1);
+	if (recordCrc(hdr, payload) != hdr->crc)
+		return(-1);
+	return(1);
+}
+
+/* In-memory variant of readRecord() for mapped files: returns the size of
+ * the valid record at buf (payload follows the header), 0 when len is 0
+ * and -1 for a torn or corrupt record. */
+long DataWriter::parseRecord(const char *buf, size_t len, DataRecordHeader *hdr){
+	if (len == 0)
+		return(0);
+	if (len < sizeof(DataRecordHeader))
+		return(-1);
+	memcpy(hdr, buf, sizeof(DataRecordHeader));
+	if (hdr->magic != DW_RECORD_MAGIC || hdr->length > DW_MAX_PAYLOAD
+			|| hdr->length > len - sizeof(DataRecordHeader))
+		return(-1);
+	if (recordCrc(hdr, buf + sizeof(DataRecordHeader)) != hdr->crc)
+		return(-1);
+	return(sizeof(DataRecordHeader) + hdr->length);
+}
+
+/* First offset at or after 'offset' holding a valid record, -1 if there is
+ * none (or on I/O error). Searches DW_SCAN_BUFFER bytes at a time for the
+ * magic and checks the crc, so a match inside a payload is not taken. */
+off_t DataWriter::nextRecord(int fd, off_t offset){
+	const uint32_t magic = DW_RECORD_MAGIC;
+	char payload[DW_MAX_PAYLOAD];
+	DataRecordHeader hdr;
+	char *buf = (char *)malloc(DW_SCAN_BUFFER);
+	if (buf == NULL)
+		return(-1);
+	for(;;){
+		ssize_t n = pread(fd, buf, DW_SCAN_BUFFER, offset);
+		if (n < (ssize_t)sizeof(DataRecordHeader))
+			break;
+		for (ssize_t i = 0; i + (ssize_t)sizeof(magic) <= n; i++){
+			if (memcmp(buf + i, &magic, sizeof(magic)) == 0
+					&& readRecord(fd, offset + i, &hdr, payload, sizeof(payload)) == 1){
+				free(buf);
+				return(offset + i);
+			}
+		}
+		offset += n - (sizeof(magic) - 1);	/* A magic split by the buffer end */
+	}
+	free(buf);
+	return(-1);
+}
+
+/* Count the valid records from offset on, reading DW_SCAN_BUFFER bytes at
+ * a time; returns the end of the last one (-1 on I/O error). A corrupt
+ * record before resyncBefore is logged and skipped up to the next valid
+ * one; at or after it, it ends the scan. */
+off_t DataWriter::scanRecords(int fd, off_t offset, off_t resyncBefore, unsigned *records,
+		off_t *lastRecord, uint32_t *lastCrc){
+	char *buf = (char *)malloc(DW_SCAN_BUFFER);
+	if (buf == NULL){
+		logMessage("DataWriter: No memory for recovery");
+		return(-1);
+	}
+	off_t end = offset;		/* End of the last valid record */
+	for(;;){
+		ssize_t n = pread(fd, buf, DW_SCAN_BUFFER, offset);
+		if (n < 0){
+			logMessage("DataWriter: Read failed during recovery (%s)",strerror(errno));
+			free(buf);
+			return(-1);
+		}
+		if (n == 0)
+			break;
+		size_t pos = 0;
+		long len;
+		DataRecordHeader hdr;
+		while ((len = parseRecord(buf + pos, n - pos, &hdr)) > 0){
+			*lastRecord = offset + pos;
+			*lastCrc = hdr.crc;
+			(*records)++;
+			pos += len;
+		}
+		offset += pos;
+		end = offset;
+		/* Buffer used up, or a record cut off by the end of a full buffer
+		 * that is read again from its start */
+		if (len == 0 || (n == DW_SCAN_BUFFER && pos > 0))
+			continue;
+		off_t next = (offset < resyncBefore) ? nextRecord(fd, offset + 1) : -1;
+		if (next < 0)
+			break;		/* The torn tail */
+		logMessage("DataWriter: Skipping %ld corrupt bytes at offset %ld",
+				(long)(next - offset),(long)offset);
+		offset = next;
+	}
+	free(buf);
+	return(end);
+}
+
+/* Scan from 'from' (a record boundary known to be on disk), truncate
+ * anything after the last valid record and return the new end of file
+ * (-1 on I/O error). See scanRecords() for resyncBefore. */
+off_t DataWriter::recover(int fd, off_t from, off_t resyncBefore, unsigned *records,
+		off_t *lastRecord, uint32_t *lastCrc){
+	struct stat sb;
+	if (fstat(fd, &sb) == -1){
+		logMessage("DataWriter: fstat failed (%s)",strerror(errno));
+		return(-1);
+	}
+	off_t offset = scanRecords(fd, from, resyncBefore, records, lastRecord, lastCrc);
+	if (offset < 0)
+		return(-1);
+	if (offset < sb.st_size){
+		logMessage("DataWriter: Truncating torn tail (%ld bytes after record %u)",
+				(long)(sb.st_size - offset),*records);
+		if (ftruncate(fd, offset) == -1 || fdatasync(fd) == -1){
+			logMessage("DataWriter: Failed to truncate torn tail (%s)",strerror(errno));
+			return(-1);
+		}
+	}
+	return(offset);
+}
+
+DataWriter::~DataWriter(void){
+	close();
+};//Destructor
@@ -0,0 +1,109 @@
+//============================================================================
+// Name        	: DataWriter.h
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.4
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Crash-consistent record file header file
+// Notes		: Every record is framed as {magic, type, length, crc32} followed
+//				:  by <length> payload bytes. Records are written straight to the
+//				:  file but only fdatasync()'d every <syncRecords> records or
+//				:  <syncMsec> milliseconds, so a power cut loses at most one
+//				:  batch. After each sync the synced end is checkpointed in
+//				:  <file>.ckpt; on open only the records past it are scanned
+//				:  and any torn tail is truncated back to the last record with
+//				:  a valid checksum. If the checkpoint doesn't match, the whole
+//				:  file is scanned and a corrupt record before the tail is
+//				:  skipped up to the next valid one rather than cut off.
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#ifndef DATAWRITER_H_
+#define DATAWRITER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define DW_RECORD_MAGIC		0x444c594c	/* "LYLD" little endian */
+#define DW_MAX_PAYLOAD		4096		/* Largest payload accepted by append() */
+#define DW_CHECKPOINT_MAGIC	0x4b43594c	/* "LYCK" little endian */
+#define DW_SCAN_BUFFER		(64*1024)	/* Read size while recovering */
+
+enum DW_RECORD_TYPE {
+	CSV_Record = 0x0001,	/* Payload is one CSV line without '\n' */
+	Export_Batch = 0x0002,	/* Payload is one spooled export datagram */
+	Raw_Frame = 0x0003		/* Payload is one RawReading (raw_frame.h) */
+};
+
+struct DataRecordHeader {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t length;	/* Payload bytes following the header */
+	uint32_t crc;		/* crc32 over type, reserved, length and payload */
+};
+
+/* Contents of <file>.ckpt, rewritten after every fdatasync() */
+struct DataCheckpoint {
+	uint32_t magic;
+	uint32_t records;		/* Records before offset */
+	uint64_t offset;		/* End of the last synced record */
+	uint64_t lastRecord;	/* Offset of that record, to check it is still there */
+	uint32_t lastCrc;		/* Its crc, ditto */
+	uint32_t crc;			/* crc32 of the fields above */
+};
+
+extern void logMessage(const char *format,...); //error reporting
+
+uint32_t crc32(uint32_t crc, const void *buf, size_t len);
+
+class DataWriter {
+private:
+	int fd;
+	int checkpointFd;		/* <file>.ckpt, -1 if it couldn't be opened */
+	off_t fileSize;			/* End of the last complete record */
+	off_t allocatedEnd;		/* End of the fallocate()'d extent */
+	off_t preallocBytes;	/* 0 disables preallocation */
+	unsigned pendingRecords;/* Records written since the last fdatasync() */
+	unsigned records;		/* Records in the file */
+	off_t lastRecord;		/* Offset of the last record, -1 if none */
+	uint32_t lastCrc;
+	int syncRecords;
+	int syncMsec;
+	struct timespec lastSync;
+
+	int preallocate(off_t need);
+	void writeCheckpoint();
+	off_t checkpointedEnd();
+public:
+	// Constructor
+	DataWriter();
+	// Interface Functions
+	int open(const char *filename, int syncRecords, int syncMsec, int preallocKb);
+	int append(DW_RECORD_TYPE type, const void *payload, uint32_t length);
+	int sync();
+	int syncIfDue();
+	long msecUntilSync();	/* When syncIfDue() next has work, -1 for never */
+	void setSyncPolicy(int syncRecords, int syncMsec);
+	int isOpen() const { return fd >= 0; }
+	int descriptor() const { return fd; }
+	off_t size() const { return fileSize; }
+	int truncate();
+	void close();
+	// Record access shared with recovery and the offline tools
+	static int readRecord(int fd, off_t offset, DataRecordHeader *hdr,
+			void *payload, uint32_t maxPayload);
+	static off_t nextRecord(int fd, off_t offset);
+	static off_t scanRecords(int fd, off_t offset, off_t resyncBefore, unsigned *records,
+			off_t *lastRecord, uint32_t *lastCrc);
+	static off_t recover(int fd, off_t from, off_t resyncBefore, unsigned *records,
+			off_t *lastRecord, uint32_t *lastCrc);
+	static long parseRecord(const char *buf, size_t len, DataRecordHeader *hdr);
+
+	virtual ~DataWriter(); // Destructor
+};
+
+#endif /* DATAWRITER_H_ */
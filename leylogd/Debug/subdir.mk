@@ -4,22 +4,37 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../DataWriter.cpp \
+../Exporter.cpp \
 ../MPL3115A2_Altimeter.cpp \
+../TimeIndex.cpp \
 ../TMP102.cpp \
 ../become_daemon.cpp \
-../main.cpp 
+../gpio.cpp \
+../main.cpp \
+../realtime.cpp 
 
 OBJS += \
+./DataWriter.o \
+./Exporter.o \
 ./MPL3115A2_Altimeter.o \
+./TimeIndex.o \
 ./TMP102.o \
 ./become_daemon.o \
-./main.o 
+./gpio.o \
+./main.o \
+./realtime.o 
 
 CPP_DEPS += \
+./DataWriter.d \
+./Exporter.d \
 ./MPL3115A2_Altimeter.d \
+./TimeIndex.d \
 ./TMP102.d \
 ./become_daemon.d \
-./main.d 
+./gpio.d \
+./main.d \
+./realtime.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -0,0 +1,377 @@
+//============================================================================
+// Name        	: Exporter.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.4
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Batched metrics exporter definition file
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+
+#include "Exporter.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+#define RECONNECT_MSEC 1000	/* Don't retry connect() more often than this */
+#define RESOLVE_MAX_MSEC 60000	/* Failed lookups back off up to this, they may block */
+
+static long elapsedMsec(const struct timespec *since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec)*1000 + (now.tv_nsec - since->tv_nsec)/1000000;
+}
+
+Exporter::Exporter(){
+	// Constructor
+	opened = 0;
+	sock = -1;
+	connected = 0;
+	memset(&addr, 0, sizeof(addr));
+	addrLen = 0;
+	node[0] = service[0] = '\0';
+	resolveFailures = 0;
+	host[0] = '\0';
+	batchLen = 0;
+	batchBytes = 1400;
+	flushMsec = 1000;
+	batchStart.tv_sec = batchStart.tv_nsec = 0;
+	lastConnect.tv_sec = lastConnect.tv_nsec = 0;
+	lastResolve.tv_sec = lastResolve.tv_nsec = 0;
+	spoolMax = 0;
+	replayOffset = 0;
+	positionFd = -1;
+	lastReplay.tv_sec = lastReplay.tv_nsec = 0;
+	replayStalled = 0;
+	sentBatches = spooledBatches = droppedBatches = 0;
+}
+
+/* "udp:<host>:<port>", "udp:[<ipv6>]:<port>" or "unix:<path>". Unix paths
+ * are used as they are; udp hosts are only split off here, see resolve() */
+int Exporter::parseEndpoint(const char *endpoint){
+	if (strncmp(endpoint, "unix:", 5) == 0){
+		struct sockaddr_un *un = (struct sockaddr_un *)&addr;
+		const char *path = endpoint + 5;
+		if (strlen(path) == 0 || strlen(path) >= sizeof(un->sun_path))
+			return(-1);
+		un->sun_family = AF_UNIX;
+		strncpy(un->sun_path, path, sizeof(un->sun_path) - 1);
+		addrLen = sizeof(struct sockaddr_un);
+		return(0);
+	}
+	if (strncmp(endpoint, "udp:", 4) != 0)
+		return(-1);
+
+	strncpy(node, endpoint + 4, sizeof(node) - 1);
+	node[sizeof(node) - 1] = '\0';
+	char *port = strrchr(node, ':');
+	if (port == NULL || strlen(port + 1) == 0 || strlen(port + 1) >= sizeof(service))
+		return(-1);
+	*port++ = '\0';
+	strcpy(service, port);
+	size_t len = strlen(node);
+	if (len >= 2 && node[0] == '[' && node[len - 1] == ']'){
+		memmove(node, node + 1, len - 2);
+		node[len - 2] = '\0';
+	}
+	return(0);
+}
+
+/* Look the udp collector up and create the socket for its address family */
+int Exporter::resolve(){
+	if (node[0] != '\0'){
+		/* RECONNECT_MSEC, doubling after each failure */
+		int shift = (resolveFailures < 6) ? resolveFailures : 6;
+		long backoff = (long)RECONNECT_MSEC << shift;
+		if (backoff > RESOLVE_MAX_MSEC)
+			backoff = RESOLVE_MAX_MSEC;
+		if (resolveFailures > 0 && elapsedMsec(&lastResolve) < backoff)
+			return(-1);
+		clock_gettime(CLOCK_MONOTONIC, &lastResolve);
+		struct addrinfo hints, *res;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_DGRAM;
+		int err = getaddrinfo(node, service, &hints, &res);
+		if (err != 0){
+			if (resolveFailures++ == 0)
+				logMessage("Exporter: Cannot resolve %s (%s), spooling until it can be",
+						node,gai_strerror(err));
+			return(-1);
+		}
+		memcpy(&addr, res->ai_addr, res->ai_addrlen);
+		addrLen = res->ai_addrlen;
+		freeaddrinfo(res);
+		if (resolveFailures > 0)
+			logMessage("Exporter: Resolved %s after %d attempts",node,resolveFailures + 1);
+		resolveFailures = 0;
+	}
+	if ((sock = socket(addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1){
+		logMessage("Exporter: socket failed (%s)",strerror(errno));
+		return(-1);
+	}
+	return(0);
+}
+
+int Exporter::open(const char *endpoint, const char *spoolFilename, int batchBytes, int flushMsec, int spoolKb){
+	if (parseEndpoint(endpoint) != 0){
+		logMessage("Exporter: Invalid endpoint \"%s\" (udp:<host>:<port> or unix:<path>)",endpoint);
+		return(-1);
+	}
+	opened = 1;
+	if (gethostname(host, sizeof(host)) == -1)
+		strcpy(host, "unknown");
+	host[sizeof(host) - 1] = '\0';
+	for (char *c = host; *c; c++)	/* Characters line protocol would need escaped */
+		if (*c == ' ' || *c == ',' || *c == '=')
+			*c = '_';
+
+	setBatchPolicy(batchBytes, flushMsec);
+	spoolMax = (off_t)spoolKb*1024;
+	if (spoolMax > 0 && spool.open(spoolFilename, EXPORT_REPLAY_BATCHES, 10000, 0) == -1)
+		logMessage("Exporter: No spool, batches will be dropped while %s is down",endpoint);
+	if (spool.isOpen()){
+		char positionName[PATH_MAX];
+		snprintf(positionName, sizeof(positionName), "%s.pos", spoolFilename);
+		if ((positionFd = ::open(positionName, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR)) < 0)
+			logMessage("Exporter: No %s, a restart will replay the whole spool (%s)",
+					positionName,strerror(errno));
+		if ((replayOffset = loadPosition()) > 0)
+			logMessage("Exporter: Resuming replay at byte %ld of %ld",
+					(long)replayOffset,(long)spool.size());
+	}
+	reconnect();
+	logMessage("Exporter: Sending to %s (%u byte batches, %d ms, %ld KiB spool)",
+			endpoint,(unsigned)this->batchBytes,this->flushMsec,(long)(spoolMax/1024));
+	return(0);
+}
+
+void Exporter::setBatchPolicy(int batchBytes, int flushMsec){
+	if (batchBytes <= 0 || batchBytes > EXPORT_MAX_DATAGRAM)
+		batchBytes = EXPORT_MAX_DATAGRAM;
+	this->batchBytes = batchBytes;
+	this->flushMsec = (flushMsec > 0) ? flushMsec : 0;
+}
+
+int Exporter::reconnect(){
+	if (connected)
+		return(0);
+	if (lastConnect.tv_sec != 0 && elapsedMsec(&lastConnect) < RECONNECT_MSEC)
+		return(-1);
+	clock_gettime(CLOCK_MONOTONIC, &lastConnect);
+	if (sock < 0 && resolve() != 0)
+		return(-1);
+	/* UDP always connects; a Unix relay that isn't listening fails here */
+	if (connect(sock, (struct sockaddr *)&addr, addrLen) == -1)
+		return(-1);
+	connected = 1;
+	return(0);
+}
+
+int Exporter::transmit(const char *data, size_t len){
+	if (reconnect() != 0)
+		return(-1);
+	ssize_t n = send(sock, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (n == (ssize_t)len)
+		return(0);
+	if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+		connected = 0;	/* Refused or relay gone, reconnect before the next try */
+	return(-1);
+}
+
+int Exporter::spoolBatch(const char *data, size_t len){
+	if (!spool.isOpen() || spool.size() + (off_t)(sizeof(DataRecordHeader) + len) > spoolMax){
+		if (droppedBatches++ == 0 || droppedBatches % 1000 == 0)
+			logMessage("Exporter: Spool full, %lu batches dropped",droppedBatches);
+		return(-1);
+	}
+	if (spool.append(Export_Batch, data, len) == -1){
+		droppedBatches++;
+		return(-1);
+	}
+	spooledBatches++;
+	return(0);
+}
+
+/* Where the last run's replay stopped: the saved offset if it is the start
+ * of a spooled datagram, the end if the spool was cut back below it (those
+ * datagrams went out before the tail was lost), otherwise 0 */
+off_t Exporter::loadPosition(){
+	struct ExportPosition pos;
+	DataRecordHeader hdr;
+	char data[EXPORT_MAX_DATAGRAM];
+
+	if (positionFd < 0 || pread(positionFd, &pos, sizeof(pos), 0) != (ssize_t)sizeof(pos))
+		return(0);
+	if (pos.magic != EXPORT_POSITION_MAGIC
+			|| pos.crc != crc32(0, &pos, offsetof(struct ExportPosition, crc)))
+		return(0);
+	if ((off_t)pos.offset >= spool.size())
+		return(spool.size());
+	if (DataWriter::readRecord(spool.descriptor(), pos.offset, &hdr, data, sizeof(data)) != 1)
+		return(0);	/* Not a record boundary, send everything rather than lose some */
+	return((off_t)pos.offset);
+}
+
+void Exporter::savePosition(){
+	if (positionFd < 0)
+		return;
+	struct ExportPosition pos;
+	memset(&pos, 0, sizeof(pos));
+	pos.magic = EXPORT_POSITION_MAGIC;
+	pos.offset = replayOffset;
+	pos.crc = crc32(0, &pos, offsetof(struct ExportPosition, crc));
+	if (pwrite(positionFd, &pos, sizeof(pos), 0) != (ssize_t)sizeof(pos))
+		logMessage("Exporter: Failed to save the replay position (%s)",strerror(errno));
+}
+
+int Exporter::replaySpool(){
+	DataRecordHeader hdr;
+	char data[EXPORT_MAX_DATAGRAM];
+	int replayed = 0;
+
+	while (replayed < EXPORT_REPLAY_BATCHES && replayOffset < spool.size()){
+		if (DataWriter::readRecord(spool.descriptor(), replayOffset, &hdr, data, sizeof(data)) != 1){
+			off_t next = DataWriter::nextRecord(spool.descriptor(), replayOffset + 1);
+			logMessage("Exporter: Skipping a corrupt spooled batch at byte %ld",(long)replayOffset);
+			replayOffset = (next < 0) ? spool.size() : next;
+			savePosition();
+			continue;
+		}
+		if (transmit(data, hdr.length) != 0)
+			return(replayed);
+		replayOffset += sizeof(DataRecordHeader) + hdr.length;
+		savePosition();
+		sentBatches++;
+		replayed++;
+	}
+	if (replayOffset >= spool.size() && spool.size() > 0){
+		logMessage("Exporter: Spool replayed (%lu batches spooled so far)",spooledBatches);
+		/* Spool first: a crash in between leaves a position past the end,
+		 * which loadPosition() reads as 0 */
+		spool.truncate();
+		replayOffset = 0;
+		savePosition();
+		if (positionFd >= 0)
+			fdatasync(positionFd);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &lastReplay);
+	replayStalled = (replayed < EXPORT_REPLAY_BATCHES && replayOffset < spool.size());
+	return(replayed);
+}
+
+int Exporter::add(const struct timeval *when, const char *fields){
+	if (!opened)
+		return(-1);
+	struct timeval now;
+	if (when == NULL){
+		gettimeofday(&now, NULL);
+		when = &now;
+	}
+	char line[EXPORT_MAX_LINE];
+	int len = snprintf(line, sizeof(line), "leylogd,host=%s %s %ld%06ld000\n",
+			host, fields, (long)when->tv_sec, (long)when->tv_usec);
+	if (len <= 0 || len >= (int)sizeof(line))
+		return(-1);
+	if (batchLen + len > batchBytes)
+		flush();
+	if (batchLen == 0)
+		clock_gettime(CLOCK_MONOTONIC, &batchStart);
+	memcpy(batch + batchLen, line, len);
+	batchLen += len;
+	return(flushIfDue());
+}
+
+int Exporter::flushIfDue(){
+	if (!opened)
+		return(-1);
+	if (batchLen > 0 && elapsedMsec(&batchStart) >= flushMsec)
+		return(flush());
+	if (replayOffset < spool.size())
+		replaySpool();
+	spool.syncIfDue();
+	return(0);
+}
+
+/* The event loop sleeps at most this long, so a batch goes out flushMsec
+ * after its oldest reading and the spool keeps draining between readings */
+long Exporter::msecUntilDue(){
+	long wait = -1;
+	if (!opened)
+		return(-1);
+	if (batchLen > 0){
+		wait = flushMsec - elapsedMsec(&batchStart);
+		if (wait < 0)
+			wait = 0;
+	}
+	if (replayOffset < spool.size()){
+		long retry = (replayStalled ? RECONNECT_MSEC : EXPORT_REPLAY_MSEC) - elapsedMsec(&lastReplay);
+		if (retry < 0)
+			retry = 0;
+		if (wait < 0 || retry < wait)
+			wait = retry;
+	}
+	long sync = spool.msecUntilSync();
+	if (sync >= 0 && (wait < 0 || sync < wait))
+		wait = sync;
+	return(wait);
+}
+
+int Exporter::flush(){
+	if (!opened)
+		return(-1);
+	int err = 0;
+	if (batchLen > 0){
+		/* Anything still spooled goes first, so queue behind it */
+		if (replayOffset >= spool.size() && transmit(batch, batchLen) == 0)
+			sentBatches++;
+		else
+			err = spoolBatch(batch, batchLen);
+		batchLen = 0;
+	}
+	if (replayOffset < spool.size())
+		replaySpool();
+	return(err);
+}
+
+void Exporter::report(){
+	logMessage("Exporter: %lu batches sent, %lu spooled, %lu dropped, %ld bytes waiting in spool",
+			sentBatches,spooledBatches,droppedBatches,(long)(spool.size() - replayOffset));
+}
+
+void Exporter::close(){
+	if (!opened)
+		return;
+	flush();
+	while (replayOffset < spool.size() && replaySpool() > 0)
+		;	/* Whatever is left is replayed after the next start */
+	report();
+	spool.close();
+	if (positionFd >= 0){
+		fdatasync(positionFd);
+		::close(positionFd);
+	}
+	positionFd = -1;
+	if (sock >= 0)
+		::close(sock);
+	sock = -1;
+	connected = 0;
+	opened = 0;
+}
+
+Exporter::~Exporter(void){
+	close();
+};//Destructor
@@ -0,0 +1,103 @@
+//============================================================================
+// Name        	: Exporter.h
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.4
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Batched metrics exporter header file
+// Notes		: Readings are formatted as line protocol
+//				:  ("leylogd,host=<name> <fields> <ns timestamp>") and coalesced
+//				:  into one datagram until it reaches <batchBytes> or its
+//				:  oldest reading is <flushMsec> old. Datagrams go to a UDP
+//				:  collector ("udp:<host>:<port>") or a local relay on a Unix
+//				:  datagram socket ("unix:<path>"), never blocking. Whatever
+//				:  can't be sent is kept in a bounded spool file and replayed,
+//				:  oldest first, once the collector accepts datagrams again.
+//				:  How far the replay got is kept in <spool>.pos after every
+//				:  datagram, so a restart part way through carries on from
+//				:  there instead of sending the delivered ones again.
+//				:  A collector host name that doesn't resolve yet (no network
+//				:  at boot) is looked up again on every reconnect attempt,
+//				:  spooling meanwhile.
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#ifndef EXPORTER_H_
+#define EXPORTER_H_
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include "DataWriter.h"
+
+#define EXPORT_MAX_DATAGRAM	DW_MAX_PAYLOAD	/* Upper bound on batchBytes */
+#define EXPORT_MAX_LINE		256
+#define EXPORT_REPLAY_BATCHES	16		/* Spooled datagrams replayed per flush */
+#define EXPORT_REPLAY_MSEC		10		/* Pause between those rounds while replaying */
+#define EXPORT_POSITION_MAGIC	0x5043594c	/* "LYCP" little endian */
+
+/* Contents of <spool>.pos, rewritten after every replayed datagram */
+struct ExportPosition {
+	uint32_t magic;
+	uint32_t reserved;
+	uint64_t offset;		/* First spooled datagram not yet replayed */
+	uint32_t crc;			/* crc32 of the fields above */
+	uint32_t pad;
+};
+
+extern void logMessage(const char *format,...); //error reporting
+
+class Exporter {
+private:
+	int opened;
+	int sock;						/* -1 until the endpoint has been resolved */
+	int connected;
+	struct sockaddr_storage addr;
+	socklen_t addrLen;
+	char node[EXPORT_MAX_LINE];		/* udp: host and port, resolved by reconnect() */
+	char service[16];
+	int resolveFailures;
+	char host[64];
+	char batch[EXPORT_MAX_DATAGRAM];
+	size_t batchLen;
+	size_t batchBytes;
+	int flushMsec;
+	struct timespec batchStart;		/* When the oldest reading in batch arrived */
+	struct timespec lastConnect;
+	struct timespec lastResolve;
+	DataWriter spool;
+	off_t spoolMax;
+	off_t replayOffset;				/* First spooled datagram not yet replayed */
+	int positionFd;					/* <spool>.pos, -1 if it couldn't be opened */
+	struct timespec lastReplay;
+	int replayStalled;				/* Last round couldn't send, wait for a reconnect */
+	unsigned long sentBatches, spooledBatches, droppedBatches;
+
+	int parseEndpoint(const char *endpoint);
+	int resolve();
+	int reconnect();
+	int transmit(const char *data, size_t len);
+	int spoolBatch(const char *data, size_t len);
+	int replaySpool();
+	off_t loadPosition();
+	void savePosition();
+public:
+	// Constructor
+	Exporter();
+	// Interface Functions
+	int open(const char *endpoint, const char *spoolFilename, int batchBytes, int flushMsec, int spoolKb);
+	int add(const struct timeval *when, const char *fields);
+	int flushIfDue();
+	long msecUntilDue();	/* When flushIfDue() next has work, -1 for never */
+	int flush();
+	void setBatchPolicy(int batchBytes, int flushMsec);
+	int isOpen() const { return opened; }
+	void report();
+	void close();
+
+	virtual ~Exporter(); // Destructor
+};
+
+#endif /* EXPORTER_H_ */
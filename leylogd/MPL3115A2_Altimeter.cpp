@@ -1,10 +1,10 @@
 //============================================================================
 // Name        	: MPL3115A2_Altimeter.cpp
 // Author      	: Christopher Ley <christopher.ley@uon.edu.au>
-// Version     	: 1.3.3
+// Version     	: 1.4.6
 // Project	   	: leylogd
 // Created     	: 05/03/15
-// Modified    	: 05/03/15
+// Modified    	: 19/10/26
 // Copyright   	: Do not modify or distribute without express written permission
 //				: of the author
 // Description 	: MPL3115A2_Altimeter class definition file
@@ -25,73 +25,130 @@ using namespace std;
 MPL3115A2_Altimeter::MPL3115A2_Altimeter(I2C_BUS bus,I2C_ADDR addr,STATE readtype){
 	I2CBus = bus;
 	I2CAddress = addr;
-	/* Configure Sensor */
+	readState = readtype;
+	busFile = -1;
+	quiet = 0;
+}
+
+/* Returns a descriptor addressed to the sensor or -1 */
+int MPL3115A2_Altimeter::openBus(){
+	if (busFile >= 0)
+		return(busFile);
 	char namebuf[MAX_BUS];
 	snprintf(namebuf, sizeof(namebuf), "/dev/i2c-%d", I2CBus);
 	int file;
 	if ((file = open(namebuf, O_RDWR)) < 0){
 		logMessage("Failed to open MPL115 Sensor on %s ISC bus",namebuf);
+		return(-1);
 	}
     if (ioctl(file, I2C_SLAVE, I2CAddress) < 0){
-    	logMessage("I2C_SALVE address %s failed [MPL115]",I2CAddress);
+    	logMessage("I2C_SALVE address 0x%02x failed [MPL115]",I2CAddress);
+    	close(file);
+    	return(-1);
     }
+	return(file);
+}
+
+void MPL3115A2_Altimeter::closeBus(int file){
+	if (file != busFile)
+		close(file);
+}
+
+int MPL3115A2_Altimeter::keepBusOpen(){
+	int file = openBus();
+	if (file < 0)
+		return(-1);
+	busFile = file;
+	return(0);
+}
+
+int MPL3115A2_Altimeter::initialise(){
+	/* Configure Sensor */
+	int file;
+	if ((file = openBus()) < 0){
+		return(-1);
+	}
     char config_buffer[2];
+    unsigned char id = 0;
+    config_buffer[0] = WHO_AM_I;
+    if ( write(file, config_buffer, 1) != 1 || read(file, &id, 1) != 1) {
+    	logMessage("MPL115: Failure to read WHO_AM_I");
+    	closeBus(file);
+    	return(-1);
+    }
+    if (id != MPL3115A2_DEVICE_ID) {
+    	logMessage("MPL115: WHO_AM_I returned 0x%02x, expected 0x%02x",id,MPL3115A2_DEVICE_ID);
+    	closeBus(file);
+    	return(-1);
+    }
 	config_buffer[0] = 0x26;
 	config_buffer[1] = 0x00;
     if ( write(file, config_buffer, 2) != 2) {
 		logMessage("MPL115: Failure to configure register 0x26");
+		closeBus(file);
+		return(-1);
 	}
     config_buffer[0] = 0x13;
     config_buffer[1] = 0x07;
     if ( write(file, config_buffer, 2) != 2) {
     	logMessage("MPL115: Failure to configure register 0x13");
+    	closeBus(file);
+    	return(-1);
 	}
-	if(readtype){ //Altimeter
-		this->readState = readtype;
+	if(readState){ //Altimeter
 	    config_buffer[0] = 0x26;
 	    config_buffer[1] = 0x80;
-	    if ( write(file, config_buffer, 2) != 2) {
-	    	logMessage("MPL115: Failure to configure register 0x26");
-		}
 	}else { //Barometer
-		this->readState = readtype;
 	    config_buffer[0] = 0x26;
 	    config_buffer[1] = 0x00;
-	    if ( write(file, config_buffer, 2) != 2) {
-	    	logMessage("MPL115: Failure to configure register 0x26");
-		}
 	}
-	close(file);
+    if ( write(file, config_buffer, 2) != 2) {
+    	logMessage("MPL115: Failure to configure register 0x26");
+    	closeBus(file);
+    	return(-1);
+	}
+	closeBus(file);
 	logMessage("Succesfully Configured MPL3115A2 (config: %02x->%02x,%02x->%02x)",config_buffer[0],config_buffer[1],0x13,0x07);
+	return(0);
 }
 
 int MPL3115A2_Altimeter::readSensor(float *pressure,float *temp){
+	unsigned char raw[MPL3115A2_RAW_BYTES];
+	if (readRaw(raw) != 0){
+		return(-1);
+	}
+	convertData(raw, readState, pressure, temp);
+//	logMessage("Bar Pressure = %f Pa ",*pressure);
+//	logMessage("MPL Temperature = %f degC",*temp);
+	return(0);
+}
+
+/* Returns 0, or 1: open failed, 2: control register write failed,
+ * 3: status poll failed, 4: data not ready in time, 5: short data read */
+int MPL3115A2_Altimeter::readRaw(unsigned char raw[MPL3115A2_RAW_BYTES]){
 	// Standard I2C Interface
-	char namebuf[MAX_BUS];
-	snprintf(namebuf, sizeof(namebuf), "/dev/i2c-%d", I2CBus);
 	int file;
-	if ((file = open(namebuf, O_RDWR)) < 0){
-		logMessage("Failed to open MPL115 Sensor on %s ISC bus",namebuf);
-		return(-1);
+	if ((file = openBus()) < 0){
+		return(1);
 	}
-    if (ioctl(file, I2C_SLAVE, I2CAddress) < 0){
-    	logMessage("I2C_SALVE address %s failed [MPL115]",I2CAddress);
-		return(-1);
-    }
     char config_buffer[2];
 	if(readState){ //Altimeter
 	    config_buffer[0] = 0x26;
 	    config_buffer[1] = 0x82;
 	    if ( write(file, config_buffer, 2) != 2) {
-	    	logMessage("MPL115: Failure to configure register 0x26");
-			return(-1);
+	    	if (!quiet)
+	    		logMessage("MPL115: Failure to configure register 0x26");
+	    	closeBus(file);
+			return(2);
 		}
 	}else { //Barometer
 	    config_buffer[0] = 0x26;
 	    config_buffer[1] = 0x02;
 	    if ( write(file, config_buffer, 2) != 2) {
-	    	logMessage("MPL115: Failure to configure register 0x26");
-			return(-1);
+	    	if (!quiet)
+	    		logMessage("MPL115: Failure to configure register 0x26");
+	    	closeBus(file);
+			return(2);
 		}
 	}
 	config_buffer[0] = 0x00;
@@ -99,11 +156,13 @@ int MPL3115A2_Altimeter::readSensor(float *pressure,float *temp){
 	int timeout = 0;
 	while(!(test & 0x08)){
 		if(write(file, config_buffer, 1) != 1){
-			logMessage("MPL115:Failed to write status byte");
-			return(-1);
+			if (!quiet)
+				logMessage("MPL115:Failed to write status byte");
+			closeBus(file);
+			return(3);
 		}
 		int bytesRead = read(file, &test, 1);
-		if (bytesRead == -1){
+		if (bytesRead == -1 && !quiet){
 			logMessage("MPL115:Failed to read status byte");
 		}
 //		if(!(test & 0x08)){
@@ -111,29 +170,105 @@ int MPL3115A2_Altimeter::readSensor(float *pressure,float *temp){
 //		}
 		timeout++;
 		if(timeout > 30){
-			logMessage("MPL115 Error(count= %d, status: %02x): Timeout!",timeout,test);
-			return(-1);
+			if (!quiet)
+				logMessage("MPL115 Error(count= %d, status: %02x): Timeout!",timeout,test);
+			closeBus(file);
+			return(4);
 		}
 	}
 	char databuffer[6];
 	int databytesRead = read(file, databuffer, 6);
-	if (databytesRead == -1){
-		logMessage("Failure to read data bytes!!");
+	if (databytesRead != 6){
+		if (!quiet)
+			logMessage("Failure to read data bytes!!");
+		closeBus(file);
+		return(5);
 	}
 //	for(int i = 0;i<6;i++){
 //		logMessage("Byte %#04x,Hex:0x%02x,Dec:%d",i,databuffer[i],databuffer[i]);
 //	}
-	if(readState) { //Altimeter
-		*pressure = ((databuffer[1]<<16) | (databuffer[2]<<8) | (databuffer[3]))/(float)(1<<8);
-	} else { //Barometer
-		*pressure = ((databuffer[1]<<16) | (databuffer[2]<<8) | (databuffer[3]))/(float)(1<<6);
+	for(int i = 0; i < MPL3115A2_RAW_BYTES; i++){
+		raw[i] = (unsigned char)databuffer[i + 1]; // databuffer[0] is STATUS
 	}
-	*temp = ((databuffer[4]<<8) | (databuffer[5]))/(float)(1<<8);
-//	logMessage("Bar Pressure = %f Pa ",*pressure);
-//	logMessage("MPL Temperature = %f degC",*temp);
-	close(file);
+	closeBus(file);
 //	logMessage("Finished writing the pressure sensor");
 	return(0);
 
 }
-MPL3115A2_Altimeter::~MPL3115A2_Altimeter(void){};//Destructor
+
+const char *MPL3115A2_Altimeter::readError(int err){
+	static const char *errors[] = {"ok", "bus open failed", "control register write failed",
+			"status poll failed", "data not ready", "short data read"};
+	return((err >= 0 && err <= 5) ? errors[err] : "unknown error");
+}
+
+/* P_TGT/P_WND are in 2 Pa steps (barometer) or signed metres (altimeter),
+ * T_TGT/T_WND in whole degC. The device compares each new measurement and
+ * raises INT1 when it crosses the target or either edge of the window. */
+int MPL3115A2_Altimeter::setThresholds(int pressure, float pTarget, float pWindow,
+		int temperature, float tTarget, float tWindow){
+	int file;
+	if ((file = openBus()) < 0){
+		return(-1);
+	}
+	int pTgt = readState ? (int)pTarget : (int)(pTarget/2);
+	int pWnd = readState ? (int)pWindow : (int)(pWindow/2);
+	char enable = (pressure ? INT_PTH : 0) | (temperature ? INT_TTH : 0);
+	char config[][2] = {
+		{CTRL_REG4, 0x00},	/* Quiet while the thresholds change */
+		{P_TGT_MSB, (char)(pTgt >> 8)},
+		{P_TGT_LSB, (char)pTgt},
+		{P_WND_MSB, (char)(pWnd >> 8)},
+		{P_WND_LSB, (char)pWnd},
+		{T_TGT, (char)(int)tTarget},
+		{T_WND, (char)(int)tWindow},
+		{CTRL_REG3, IPOL1},
+		{CTRL_REG5, enable},
+		{CTRL_REG4, enable}
+	};
+	for(unsigned i = 0; i < sizeof(config)/sizeof(config[0]); i++){
+		if (write(file, config[i], 2) != 2){
+			logMessage("MPL115: Failure to configure register 0x%02x",config[i][0]);
+			closeBus(file);
+			return(-1);
+		}
+	}
+	closeBus(file);
+	logMessage("MPL3115A2 threshold interrupts on INT1 (CTRL_REG4: %02x)",enable);
+	return(0);
+}
+
+int MPL3115A2_Altimeter::readInterruptSource(){
+	int file;
+	if ((file = openBus()) < 0){
+		return(-1);
+	}
+	char reg = INT_SOURCE;
+	unsigned char source = 0;
+	if (write(file, &reg, 1) != 1 || read(file, &source, 1) != 1){
+		if (!quiet)
+			logMessage("MPL115: Failure to read INT_SOURCE");
+		closeBus(file);
+		return(-1);
+	}
+	closeBus(file);
+	return(source);
+}
+
+/* Pressure is unsigned Q18.2 Pa and altitude signed Q16.4 m, both left
+ * justified in 24 bits; temperature is signed Q8.4 degC in 16 bits. */
+void MPL3115A2_Altimeter::convertData(const unsigned char raw[MPL3115A2_RAW_BYTES], STATE readtype,
+		float *pressure, float *temp){
+	if(readtype) { //Altimeter
+		long altitude = (signed char)raw[0]*65536L + (raw[1]<<8) + raw[2];
+		*pressure = altitude/(float)(1<<8);
+	} else { //Barometer
+		unsigned long bar = ((unsigned long)raw[0]<<16) | (raw[1]<<8) | raw[2];
+		*pressure = bar/(float)(1<<6);
+	}
+	*temp = ((signed char)raw[3]*256 + raw[4])/(float)(1<<8);
+}
+MPL3115A2_Altimeter::~MPL3115A2_Altimeter(void){
+	if (busFile >= 0)
+		close(busFile);
+};//Destructor
@@ -1,10 +1,10 @@
 //============================================================================
 // Name        	: MPL3115A2_Altimeter.h
 // Author      	: Christopher Ley <christopher.ley@uon.edu.au>
-// Version     	: 1.3.3
+// Version     	: 1.4.6
 // Project	   	: leylogd
 // Created     	: 05/03/15
-// Modified    	: 05/03/15
+// Modified    	: 19/10/26
 // Copyright   	: Do not modify or distribute without express written permission
 //				: of the author
 // Description 	: MPL3115A2_Altimeter header file
@@ -17,6 +17,8 @@
 #include "I2C_interface.h"
 
 #define MPL3115A2_I2C_BUFFER 0x80
+#define MPL3115A2_DEVICE_ID 0xc4	/* Fixed WHO_AM_I value */
+#define MPL3115A2_RAW_BYTES 5		/* OUT_P_MSB..OUT_T_LSB */
 
 enum ALTIMETER_REG_ADDR {
 	STATUS =		0x00,
@@ -76,6 +78,22 @@ enum CTRL_REG1_FLAGS { // Default 0x00
 	RAW = 	0x40,
 	ALT = 	0x80
 };
+enum CTRL_REG3_FLAGS { // Default 0x00, open drain active low
+	PP_OD2 =	0x01,
+	IPOL2 =		0x02,
+	PP_OD1 =	0x10,
+	IPOL1 =		0x20
+};
+enum INT_FLAGS { // CTRL_REG4 enables, CTRL_REG5 routes to INT1, INT_SOURCE reports
+	INT_TCHG =	0x01,
+	INT_PCHG =	0x02,
+	INT_TTH =	0x04,
+	INT_PTH =	0x08,
+	INT_TW =	0x10,
+	INT_PW =	0x20,
+	INT_FIFO =	0x40,
+	INT_DRDY =	0x80
+};
 enum I2C_ADDR {
 	Standard = 0x60
 };
@@ -94,13 +112,31 @@ private:
 	char dataBuffer[MPL3115A2_I2C_BUFFER];
 	char CtrlRegState;
 	STATE readState;
+	int busFile; // held open by keepBusOpen(), otherwise -1
+	int quiet; // readRaw()/readInterruptSource() failures returned only, not logged
+
+	int openBus();
+	void closeBus(int file);
 public:
-	//Constructor
+	//Constructor (no bus access, see initialise())
 	MPL3115A2_Altimeter(I2C_BUS bus,I2C_ADDR addr,STATE readtype);
 	//Destructor
 	virtual ~MPL3115A2_Altimeter();
 	//Interface Functions
+	int initialise(); // verify WHO_AM_I and configure, 0 on success
 	int readSensor(float *pressure,float *temp);
+	int readRaw(unsigned char raw[MPL3115A2_RAW_BYTES]); // OUT_P/OUT_T bytes, 0 on success
+	static const char *readError(int err); // describes a readRaw() return code
+	int keepBusOpen(); // reuse one descriptor for every read (real-time mode)
+	void setQuiet(int quiet) { this->quiet = quiet; } // leave logging read failures to the caller
+	// Threshold interrupts on INT1 (active high, push-pull), a zero enable skips that one
+	int setThresholds(int pressure, float pTarget, float pWindow,
+			int temperature, float tTarget, float tWindow);
+	int readInterruptSource(); // INT_SOURCE, -1 on failure
+	STATE state() const { return readState; }
+	// Shared with leylogd-replay so raw frames convert exactly as live readings do
+	static void convertData(const unsigned char raw[MPL3115A2_RAW_BYTES], STATE readtype,
+			float *pressure, float *temp);
 
 };
 
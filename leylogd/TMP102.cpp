@@ -1,10 +1,10 @@
 //============================================================================
 // Name        	: TMP102.h
 // Author      	: Christopher Ley <christopher.ley@uon.edu.au>
-// Version     	: 1.3.3
+// Version     	: 1.4.4
 // Project	   	: leylogd
 // Created     	: 04/03/15
-// Modified    	: 05/03/15
+// Modified    	: 19/10/26
 // Copyright   	: Do not modify or distribute without express written permission
 //				: of the author
 // Description 	: TMP102 class definition file
@@ -24,76 +24,148 @@ using namespace std;
 #define MAX_BUS 64
 #define CONFIG_REGISTER 0x01
 #define TEMP_REGISTER 0x00
+#define CONFIG_RESOLUTION 0x60	/* R1:R0 read-only, always set on a TMP102 */
 
 TMP102::TMP102(I2C_BUS bus, TMP102_ADDR address,TMP102_CONFIG_MSB msb, TMP102_CONFIG_LSB lsb){
 	// Constructor
 	I2CBus = bus;
 	I2CAddress = address;
-	setConfigurationRegister(msb,lsb);
+	configMSB = msb;
+	configLSB = lsb;
+	busFile = -1;
+	quiet = 0;
 }
 
-float TMP102::readTemperature(){
-//	logMessage("Starting Temperature Read");
-	// pointer to device address
+/* Returns a descriptor addressed to the sensor, -1 if the bus could not be
+ * opened and -2 if the slave address could not be set */
+int TMP102::openBus(){
+	if (busFile >= 0)
+		return(busFile);
 	char namebuf[MAX_BUS];
 	// overloaded safer formated string
 	snprintf(namebuf,sizeof(namebuf),"/dev/i2c-%d",I2CBus);
 	int file;
 	if ((file = open(namebuf, O_RDWR)) < 0){
 		logMessage("Failed to open TMP102 Sensor on %s ISC bus",namebuf);
-		return(1);
+		return(-1);
 	}
 	if (ioctl(file, I2C_SLAVE, I2CAddress) < 0){
-		logMessage("I2C_SALVE address %s failed [TMP102]",I2CAddress);
-		return(2);
+		logMessage("I2C_SALVE address 0x%02x failed [TMP102]",I2CAddress);
+		close(file);
+		return(-2);
+	}
+	return(file);
+}
+
+void TMP102::closeBus(int file){
+	if (file != busFile)
+		close(file);
+}
+
+int TMP102::keepBusOpen(){
+	int file = openBus();
+	if (file < 0)
+		return(-1);
+	busFile = file;
+	return(0);
+}
+
+int TMP102::initialise(){
+	return(setConfigurationRegister(configMSB,configLSB));
+}
+
+float TMP102::readTemperature(){
+	unsigned char raw[TMP102_I2C_BUFFER];
+	int err = readRaw(raw);
+	if (err != 0){
+		return(err);
+	}
+	this->temperature = convertTemperature(raw[0],raw[1]);
+//	logMessage("Temperature %f degC", this->temperature);
+	return(this->temperature);
+}
+
+/* Returns 0, or 1: open failed, 2: slave address failed, 3: register
+ * address failed, 4: short read */
+int TMP102::readRaw(unsigned char raw[TMP102_I2C_BUFFER]){
+//	logMessage("Starting Temperature Read");
+	int file = openBus();
+	if (file < 0){
+		return(-file);
 	}
 	char buf[1] = {TEMP_REGISTER};
 	if(write(file, buf, 1) != 1){
-		logMessage("Failed to address Temperature register");
+		if (!quiet)
+			logMessage("Failed to address Temperature register");
+		closeBus(file);
 		return(3);
 	}
 	int bytesRead = read(file, this->dataBuffer, 2);
 	if (bytesRead == -1){
-		logMessage("Failure to read Byte Stream in readTemperature()");
+		if (!quiet)
+			logMessage("Failure to read Byte Stream in readTemperature()");
+		closeBus(file);
+		return(4);
 	}
 	else if (bytesRead != 2){
-		logMessage("Incorrect read value in TMP102");
+		if (!quiet)
+			logMessage("Incorrect read value in TMP102");
+		closeBus(file);
 		return(4);
 	}
-	else{
-		/* Used for tuning */
-//		logMessage("Number of bytes read was %d",bytesRead);
-//		logMessage("Raw Data (Hex): 0x%02x\t 0x%02x",this->dataBuffer[0],this->dataBuffer[1]);
-		this->temperature = convertTemperature(this->dataBuffer[0],this->dataBuffer[1]);
-//		logMessage("Temperature %f degC", this->temperature);
-	}
+	/* Used for tuning */
+//	logMessage("Number of bytes read was %d",bytesRead);
+//	logMessage("Raw Data (Hex): 0x%02x\t 0x%02x",this->dataBuffer[0],this->dataBuffer[1]);
+	raw[0] = (unsigned char)this->dataBuffer[0];
+	raw[1] = (unsigned char)this->dataBuffer[1];
+	closeBus(file);
+	return(0);
+}
 
-	close(file);
-	return(this->temperature);
+const char *TMP102::readError(int err){
+	static const char *errors[] = {"ok", "bus open failed", "slave address failed",
+			"register address failed", "short read"};
+	return((err >= 0 && err <= 4) ? errors[err] : "unknown error");
 }
 
 int TMP102::setConfigurationRegister(TMP102_CONFIG_MSB msb,TMP102_CONFIG_LSB lsb){
 	// Write buffer
-	char namebuf[MAX_BUS];
-	snprintf(namebuf, sizeof(namebuf),"/dev/i2c-%d", I2CBus);
-	int file;
-	if ((file = open(namebuf, O_RDWR)) < 0){
-		logMessage("Failed to open TMP102 Sensor on %s I2C Bus",namebuf);
-		return(1);
-	}
-	if (ioctl(file, I2C_SLAVE, I2CAddress) < 0){
-		logMessage("I2C_SALVE address %s failed",I2CAddress);
-		return(2);
+	int file = openBus();
+	if (file < 0){
+		return(-file);
 	}
-	char buffer[3] = {CONFIG_REGISTER, msb, lsb};
+	char buffer[3] = {CONFIG_REGISTER, (char)msb, (char)lsb};
 	if (write(file, buffer, 3) != 3){
 		logMessage("Failure to write TMP102 configuration register.");
+		closeBus(file);
+		return(3);
 	}
-	close(file);
+	if (verifyIdentity(file) != 0){
+		closeBus(file);
+		return(4);
+	}
+	closeBus(file);
 	logMessage("Succesfully Configured TMP102 (config: %02x->{%02x,%02x})",CONFIG_REGISTER,msb,lsb);
 	return(0);
 }
 
+/* The TMP102 has no WHO_AM_I register; read the configuration register back
+ * and check the read-only resolution bits instead. */
+int TMP102::verifyIdentity(int file){
+	char buf[1] = {CONFIG_REGISTER};
+	unsigned char config[2];
+	if (write(file, buf, 1) != 1 || read(file, config, 2) != 2){
+		logMessage("TMP102: Failed to read back configuration register");
+		return(-1);
+	}
+	if ((config[0] & CONFIG_RESOLUTION) != CONFIG_RESOLUTION){
+		logMessage("TMP102: Unexpected configuration 0x%02x%02x, not a TMP102?",config[0],config[1]);
+		return(-1);
+	}
+	return(0);
+}
+
+/* msb and lsb are the register bytes as unsigned values (0-255) */
 float TMP102::convertTemperature(int msb, int lsb){
 	// Conversion type
 	short tempValue;
@@ -116,5 +188,8 @@ float TMP102::convertTemperature(int msb, int lsb){
 //	logMessage("int value of temp: %d",tempValue);
 	return(0.0625*((float)tempValue));
 }
-TMP102::~TMP102(void){};//Destructor
+TMP102::~TMP102(void){
+	if (busFile >= 0)
+		close(busFile);
+};//Destructor
 
@@ -1,10 +1,10 @@
 //============================================================================
 // Name        	: TMP102.h
 // Author      	: Christopher Ley <christopher.ley@uon.edu.au>
-// Version     	: 1.3.3
+// Version     	: 1.4.4
 // Project	   	: leylogd
 // Created     	: 04/03/15
-// Modified    	: 05/03/15
+// Modified    	: 19/10/26
 // Copyright   	: Do not modify or distribute without express written permission
 //				: of the author
 // Description 	: TMP102 header file
@@ -47,14 +47,28 @@ private:
 	int I2CBus;
 	char dataBuffer[TMP102_I2C_BUFFER];
 	float temperature; // accurate to 0.0625 degC
+	TMP102_CONFIG_MSB configMSB;
+	TMP102_CONFIG_LSB configLSB;
+	int busFile; // held open by keepBusOpen(), otherwise -1
+	int quiet; // readRaw() failures returned only, not logged
 
-	float convertTemperature(int msb, int lsb);
+	int openBus();
+	void closeBus(int file);
+
+	int verifyIdentity(int file);
 public:
-	// Constructor
+	// Constructor (no bus access, see initialise())
 	TMP102(I2C_BUS bus, TMP102_ADDR address,TMP102_CONFIG_MSB msb, TMP102_CONFIG_LSB lsb);
+	int initialise(); // configure and verify the device, 0 on success
 	int setConfigurationRegister(TMP102_CONFIG_MSB msb,TMP102_CONFIG_LSB lsb);
+	int keepBusOpen(); // reuse one descriptor for every read (real-time mode)
+	void setQuiet(int quiet) { this->quiet = quiet; } // leave logging read failures to the caller
 	// Interface Functions
 	float readTemperature();
+	int readRaw(unsigned char raw[TMP102_I2C_BUFFER]); // temperature register bytes, 0 on success
+	static const char *readError(int err); // describes a readRaw() return code
+	// Shared with leylogd-replay so raw frames convert exactly as live readings do
+	static float convertTemperature(int msb, int lsb);
 
 	virtual ~TMP102(); // Destructor
 };
@@ -0,0 +1,137 @@
+//============================================================================
+// Name        	: TimeIndex.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.5
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Sparse time index over the data file definition file
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+
+#include "TimeIndex.h"
+#include "DataWriter.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+static uint32_t entryCrc(const TimeIndexEntry *entry)
+{
+	return crc32(0, entry, sizeof(entry->usec) + sizeof(entry->offset) + sizeof(entry->flags));
+}
+
+TimeIndex::TimeIndex(){
+	// Constructor
+	fd = -1;
+	everyRecords = 0;
+	everySec = 0;
+	sinceEntry = 0;
+	lastUsec = 0;
+}
+
+/* Open (or create) the index, dropping a torn last entry and any entries
+ * past dataSize, which point at rows lost when the data file was cut back */
+int TimeIndex::open(const char *filename, uint64_t dataSize, int everyRecords, int everySec){
+	if ((fd = ::open(filename, O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR)) < 0){
+		logMessage("TimeIndex: Failed to open %s (%s)",filename,strerror(errno));
+		return(-1);
+	}
+	TimeIndexEntry entry;
+	off_t valid = 0;
+	while (pread(fd, &entry, sizeof(entry), valid) == (ssize_t)sizeof(entry)
+			&& entry.crc == entryCrc(&entry) && entry.offset < dataSize)
+		valid += sizeof(entry);
+	struct stat sb;
+	if (fstat(fd, &sb) == 0 && sb.st_size > valid){
+		logMessage("TimeIndex: Dropping %ld stale bytes from %s",(long)(sb.st_size - valid),filename);
+		if (ftruncate(fd, valid) == -1)
+			logMessage("TimeIndex: ftruncate failed (%s)",strerror(errno));
+	}
+	setPolicy(everyRecords, everySec);
+	return(0);
+}
+
+void TimeIndex::setPolicy(int everyRecords, int everySec){
+	this->everyRecords = (everyRecords > 0) ? everyRecords : 0;
+	this->everySec = (everySec > 0) ? everySec : 0;
+}
+
+int TimeIndex::writeEntry(int64_t usec, uint64_t offset, uint32_t flags){
+	TimeIndexEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.usec = usec;
+	entry.offset = offset;
+	entry.flags = flags;
+	entry.crc = entryCrc(&entry);
+	if (write(fd, &entry, sizeof(entry)) != (ssize_t)sizeof(entry)){
+		logMessage("TimeIndex: Failed to write entry (%s)",strerror(errno));
+		return(-1);
+	}
+	sinceEntry = 0;
+	lastUsec = usec;
+	return(0);
+}
+
+int TimeIndex::startSegment(int64_t usec, uint64_t offset){
+	if (fd < 0)
+		return(-1);
+	return(writeEntry(usec, offset, TI_SEGMENT_START));
+}
+
+/* Called for every row written; adds an entry when one is due */
+int TimeIndex::note(int64_t usec, uint64_t offset){
+	if (fd < 0)
+		return(-1);
+	if ((everyRecords > 0 && ++sinceEntry >= everyRecords)
+			|| (everySec > 0 && usec - lastUsec >= everySec*1000000LL))
+		return(writeEntry(usec, offset, 0));
+	return(0);
+}
+
+void TimeIndex::close(){
+	if (fd < 0)
+		return;
+	::close(fd);
+	fd = -1;
+}
+
+/* Read every valid entry into a malloc()'d array; returns the count or -1 */
+long TimeIndex::load(const char *filename, TimeIndexEntry **entries){
+	int ifd = ::open(filename, O_RDONLY);
+	struct stat sb;
+	if (ifd < 0 || fstat(ifd, &sb) == -1){
+		if (ifd >= 0)
+			::close(ifd);
+		return(-1);
+	}
+	long n = sb.st_size/sizeof(TimeIndexEntry);
+	*entries = (TimeIndexEntry *)malloc((n ? n : 1)*sizeof(TimeIndexEntry));
+	if (*entries == NULL){
+		::close(ifd);
+		return(-1);
+	}
+	ssize_t got = pread(ifd, *entries, n*sizeof(TimeIndexEntry), 0);
+	::close(ifd);
+	if (got < 0)
+		got = 0;
+	n = got/sizeof(TimeIndexEntry);
+	for (long i = 0; i < n; i++){
+		if ((*entries)[i].crc != entryCrc(&(*entries)[i]))
+			return(i);
+	}
+	return(n);
+}
+
+int64_t TimeIndex::toUsec(const struct timeval *tv){
+	return (int64_t)tv->tv_sec*1000000 + tv->tv_usec;
+}
+
+TimeIndex::~TimeIndex(void){
+	close();
+};//Destructor
@@ -0,0 +1,64 @@
+//============================================================================
+// Name        	: TimeIndex.h
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.5
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Sparse time index over the data file header file
+// Notes		: <data file>.idx holds fixed size entries mapping an absolute
+//				:  time (epoch microseconds) to the byte offset of the data
+//				:  row logged at that time. One is written when each daemon
+//				:  run (segment) starts, at its header row, and then every
+//				:  <everyRecords> rows or <everySec> seconds. The csv time
+//				:  column counts from the segment start, so readers add it to
+//				:  the time of the latest TI_SEGMENT_START entry.
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#ifndef TIMEINDEX_H_
+#define TIMEINDEX_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+/* Bit-mask values for TimeIndexEntry.flags */
+#define TI_SEGMENT_START	01		/* Header row of a new daemon run */
+
+struct TimeIndexEntry {
+	int64_t usec;		/* Absolute time of the row at offset */
+	uint64_t offset;	/* Byte offset of the row in the data file */
+	uint32_t flags;
+	uint32_t crc;		/* crc32 of the fields above */
+};
+
+extern void logMessage(const char *format,...); //error reporting
+
+class TimeIndex {
+private:
+	int fd;
+	int everyRecords;
+	int everySec;
+	int sinceEntry;		/* Rows since the last entry */
+	int64_t lastUsec;	/* Time of the last entry */
+
+	int writeEntry(int64_t usec, uint64_t offset, uint32_t flags);
+public:
+	// Constructor
+	TimeIndex();
+	// Interface Functions
+	int open(const char *filename, uint64_t dataSize, int everyRecords, int everySec);
+	void setPolicy(int everyRecords, int everySec);
+	int startSegment(int64_t usec, uint64_t offset);
+	int note(int64_t usec, uint64_t offset);
+	int isOpen() const { return fd >= 0; }
+	void close();
+	// Reader side, shared with leylogd-query
+	static long load(const char *filename, TimeIndexEntry **entries);
+	static int64_t toUsec(const struct timeval *tv);
+
+	virtual ~TimeIndex(); // Destructor
+};
+
+#endif /* TIMEINDEX_H_ */
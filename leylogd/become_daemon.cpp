@@ -1,10 +1,10 @@
 //============================================================================
 // Name        	: become_daemon.cpp
 // Author      	: Christopher Ley <christopher.ley@uon.edu.au>
-// Version     	: 1.2
+// Version     	: 1.4.1
 // Project	   	: leylogd
 // Created     	: 24/02/15
-// Modified    	: 04/03/15
+// Modified    	: 19/10/26
 // Copyright   	: Do not modify or distribute without express written permission
 //				: of the author
 // Description 	: Daemon process creation definition file
@@ -12,30 +12,78 @@
 //===========================================================================
 
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include "become_daemon.h"
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
-int becomeDaemon(int flags)
+/* Linux 5.9; older kernel headers (e.g. the gcc 4.7 armhf toolchain) don't
+ * define it, and the number is the same on arm and x86_64. An older kernel
+ * answers ENOSYS and the fallbacks below run. */
+#ifndef __NR_close_range
+#define __NR_close_range 436
+#endif
+
+/* Close every descriptor >= lowfd. close_range() does it in one syscall,
+ * /proc/self/fd only visits descriptors that are actually open, and the
+ * sysconf(_SC_OPEN_MAX) sweep is kept as the last resort. */
+int closeAllFiles(int lowfd)
 {
 	int maxfd, fd;
 
-	switch(fork()){		/*Become a background process */
-	case -1: return -1;	/* Failure */
-	case 0: break;		/* Child falls through... */
-	default: _exit(EXIT_SUCCESS);
-	/* no break */
+	if (syscall(__NR_close_range, (unsigned int)lowfd, ~0U, 0) == 0)
+		return 0;
+
+	DIR *dir = opendir("/proc/self/fd");
+	if (dir != NULL) {
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (entry->d_name[0] == '.')
+				continue;
+			fd = atoi(entry->d_name);
+			if (fd >= lowfd && fd != dirfd(dir))
+				close(fd);
+		}
+		closedir(dir);
+		return 0;
 	}
 
-	if (setsid() == -1)	/* Become leader of new session */
-		return -1;
+	maxfd = sysconf(_SC_OPEN_MAX);
+	if(maxfd == -1)					/* Limit is indeterminate.. */
+		maxfd = BD_MAX_CLOSE;		/* so take a guess */
+
+	for (fd = lowfd; fd < maxfd; fd++)
+		close(fd);
+	return 0;
+}
+
+int becomeDaemon(int flags)
+{
+	int fd;
+
+	if (!(flags & BD_NO_FORK)) {
+		switch(fork()){		/*Become a background process */
+		case -1: return -1;	/* Failure */
+		case 0: break;		/* Child falls through... */
+		default: _exit(EXIT_SUCCESS);
+		/* no break */
+		}
 
-	switch (fork()) {	/* Ensure we are not session leader */
-	case -1: return -1;
-	case 0: break;
-	default: _exit(EXIT_SUCCESS);
-	/* no break*/
+		if (setsid() == -1)	/* Become leader of new session */
+			return -1;
+
+		switch (fork()) {	/* Ensure we are not session leader */
+		case -1: return -1;
+		case 0: break;
+		default: _exit(EXIT_SUCCESS);
+		/* no break*/
+		}
 	}
 
 	if (!(flags & BD_NO_UMASK0))
@@ -44,14 +92,8 @@ int becomeDaemon(int flags)
 	if (!(flags & BD_NO_CHDIR))
 		chdir("/");	/* Change to root directory */
 
-	if(!(flags & BD_NO_CLOSE_FILES)) { /* Close all open files */
-		maxfd = sysconf(_SC_OPEN_MAX);
-		if(maxfd == -1)					/* Limit is indeterminate.. */
-			maxfd = BD_MAX_CLOSE;		/* so take a guess */
-
-		for (fd = 0; fd < maxfd; fd++)
-			close(fd);
-	}
+	if(!(flags & BD_NO_CLOSE_FILES))  /* Close all open files */
+		closeAllFiles(0);
 
 	if (!(flags & BD_NO_REOPEN_STD_FDS)) {
 		close(STDIN_FILENO);			/* Reopen standard fd's to /dev/null */
@@ -65,3 +107,33 @@ int becomeDaemon(int flags)
 
 	return 0;
 }
+
+/* Send a state string such as "READY=1" to the service manager socket named
+ * in $NOTIFY_SOCKET (systemd Type=notify). Returns 0 when not supervised. */
+int daemonNotify(const char *state)
+{
+	const char *path = getenv("NOTIFY_SOCKET");
+	struct sockaddr_un addr;
+	socklen_t len;
+	int sfd;
+
+	if (path == NULL || (path[0] != '/' && path[0] != '@'))
+		return 0;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	len = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+	if (path[0] == '@')
+		addr.sun_path[0] = '\0';	/* Abstract namespace socket */
+	else
+		len++;						/* Include the terminating '\0' */
+
+	if ((sfd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) == -1)
+		return -1;
+	ssize_t sent = sendto(sfd, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *)&addr, len);
+	close(sfd);
+	return (sent == (ssize_t)strlen(state)) ? 0 : -1;
+}
@@ -1,10 +1,10 @@
 //============================================================================
 // Name        	: become_daemon.h
 // Author      	: Christopher Ley <christopher.ley@uon.edu.au>
-// Version     	: 1.2
+// Version     	: 1.4.1
 // Project	   	: leylogd
 // Created     	: 24/02/15
-// Modified    	: 04/03/15
+// Modified    	: 19/10/26
 // Copyright   	: Do not modify or distribute without express written permission
 //				: of the author
 // Description 	: Daemon process creation definition header file
@@ -19,8 +19,11 @@
 #define BD_NO_CLOSE_FILES		02		/* Don't close all open files */
 #define BD_NO_REOPEN_STD_FDS	04		/* Don't reopen stdin, stdout, and stderr to /dev/null */
 #define BD_NO_UMASK0			010		/* Don't do a umask(0) */
+#define BD_NO_FORK				020		/* Don't fork()/setsid(), the service manager supervises us */
 #define BD_MAX_CLOSE			8192	/* Maximum file descriptors to close if sysconf(_SC_OPEN_MAX) is indeterminate */
 
 int becomeDaemon(int flags);
+int closeAllFiles(int lowfd);
+int daemonNotify(const char *state);	/* sd_notify() style readiness, no-op without $NOTIFY_SOCKET */
 
 #endif
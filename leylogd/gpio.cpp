@@ -0,0 +1,79 @@
+//============================================================================
+// Name        	: gpio.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.6
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: sysfs GPIO edge events definition file
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+
+#include "gpio.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+extern void logMessage(const char *format,...); //error reporting
+
+static int writeAttribute(const char *path, const char *value)
+{
+	int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	ssize_t len = strlen(value);
+	int err = (write(fd, value, len) == len) ? 0 : -1;
+	close(fd);
+	return err;
+}
+
+int gpioOpenEdge(int gpio, const char *edge)
+{
+	char path[64], value[16];
+
+	snprintf(path, sizeof(path), GPIO_SYSFS "/gpio%d/value", gpio);
+	if (access(path, F_OK) == -1) {
+		snprintf(value, sizeof(value), "%d", gpio);
+		if (writeAttribute(GPIO_SYSFS "/export", value) == -1 && errno != EBUSY) {
+			logMessage("GPIO: Failed to export gpio%d (%s)", gpio, strerror(errno));
+			return -1;
+		}
+	}
+	snprintf(path, sizeof(path), GPIO_SYSFS "/gpio%d/direction", gpio);
+	if (writeAttribute(path, "in") == -1) {
+		logMessage("GPIO: Failed to make gpio%d an input (%s)", gpio, strerror(errno));
+		return -1;
+	}
+	snprintf(path, sizeof(path), GPIO_SYSFS "/gpio%d/edge", gpio);
+	if (writeAttribute(path, edge) == -1) {
+		logMessage("GPIO: gpio%d can't interrupt on %s edges (%s)", gpio, edge, strerror(errno));
+		return -1;
+	}
+	snprintf(path, sizeof(path), GPIO_SYSFS "/gpio%d/value", gpio);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		logMessage("GPIO: Failed to open %s (%s)", path, strerror(errno));
+		return -1;
+	}
+	gpioAcknowledge(fd);	/* poll() reports the initial state otherwise */
+	return fd;
+}
+
+/* sysfs only signals the next edge once the value has been read again */
+int gpioAcknowledge(int fd)
+{
+	char c;
+	if (lseek(fd, 0, SEEK_SET) == -1 || read(fd, &c, 1) != 1)
+		return -1;
+	return c == '1';
+}
+
+void gpioClose(int fd)
+{
+	if (fd >= 0)
+		close(fd);
+}
@@ -0,0 +1,26 @@
+//============================================================================
+// Name        	: gpio.h
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.6
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: sysfs GPIO edge events header file
+// Notes		: gpioOpenEdge() exports the pin, makes it an input and
+//				:  returns its value descriptor, which poll() reports with
+//				:  POLLPRI on every <edge> ("rising", "falling" or "both").
+//				:  gpioAcknowledge() rearms it after each event.
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#ifndef GPIO_H_
+#define GPIO_H_
+
+#define GPIO_SYSFS	"/sys/class/gpio"
+
+int gpioOpenEdge(int gpio, const char *edge);
+int gpioAcknowledge(int fd);	/* Returns the pin level, -1 on error */
+void gpioClose(int fd);
+
+#endif /* GPIO_H_ */
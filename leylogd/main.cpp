@@ -1,10 +1,10 @@
 //============================================================================
 // Name       	: main.cpp
 // Author      	: Christopher Ley <christopher.ley@uon.edu.au>
-// Version     	: 1.3.3
+// Version     	: 1.4.6
 // Project	   	: leylogd
 // Created     	: 24/02/15
-// Modified    	: 05/03/15
+// Modified    	: 19/10/26
 // Copyright   	: Do not modify or distribute without express written permission
 //				: of the author
 // Description 	: main file for leylogd daemon process ARM variant
@@ -16,6 +16,8 @@
 // *WARNING: leyld.conf needs to receive EXACTLY that form of argument
 // *NOTE: <int second> is a integer second value i.e. 30 as is
 // *NOTE: <int microseconds> is a integer micro-second value i.e. 30
+// *NOTE: further lines of leyld.conf are optional "<key>: <value>" pairs,
+//			see readConfigFile() for the recognised keys
 //
 //				: Version 1.2.x  stable;
 //				- all init.d handlers and interrupts [stable v1.2]
@@ -24,6 +26,14 @@
 //				- TMP102 data logging [stable v1.3.0]
 //				- MPL3115A2 data logging [stable v1.3.3]
 //				- independent logging file "/var/log/leyld.csv" [stable v1.3.1]
+//				: Version 1.4.x latest development;
+//				- durable checksummed data file "/var/log/leyld.dat" [v1.4.0]
+//				- concurrent sensor probing, systemd Type=notify readiness [v1.4.1]
+//				- opt-in SCHED_FIFO acquisition thread with jitter reporting [v1.4.2]
+//				- batched line protocol export to a UDP/Unix collector [v1.4.3]
+//				- raw register frame log "/var/log/leyld.raw" for leylogd-replay [v1.4.4]
+//				- sparse time index "<data file>.idx" for leylogd-query [v1.4.5]
+//				- threshold triggered burst capture with a pre-trigger ring [v1.4.6]
 //
 // GitHub		: https://github.com/ChristopherLey/leylogd.git
 //============================================================================
@@ -36,7 +46,17 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <poll.h>
 #include "become_daemon.h"
+#include "DataWriter.h"
+#include "Exporter.h"
+#include "realtime.h"
+#include "TimeIndex.h"
+#include "gpio.h"
+#include "raw_frame.h"
 #include "TMP102.h"
 #include "MPL3115A2_Altimeter.h"
 
@@ -46,8 +66,44 @@ static FILE *logfp;		/* Log file stream */
 static FILE *datafp;    /* Data file stream */
 static const char *LOG_FILE = "/var/log/leyld.log";
 static const char *DATA_FILE = "var/log/leyld.csv";
+static const char *DURABLE_FILE = "/var/log/leyld.dat";
+static const char *SPOOL_FILE = "/var/log/leyld.spool";
+static const char *RAW_FILE = "/var/log/leyld.raw";
 static const char *CONFIG_FILE = "/etc/leylogd/leyld.conf";
 
+static DataWriter durableData;	/* Used instead of datafp when durable: 1 */
+static Exporter exporter;		/* Open when export: is configured */
+static DataWriter rawData;		/* Raw register frames when raw_log: 1 */
+static TimeIndex dataIndex;		/* Time -> offset entries for the active data file */
+
+/****** Runtime options (leyld.conf key/value lines) ******/
+struct leyldOptions {
+	int durable;		/* Write checksummed records instead of plain csv */
+	int syncRecords;	/* fdatasync() after this many records... */
+	int syncMsec;		/* ...or once this many milliseconds have passed */
+	int preallocKb;		/* fallocate() granularity, 0 to disable */
+	int rawLog;			/* Also keep raw register frames for leylogd-replay */
+	int indexRecords;	/* Time index entry every this many rows... */
+	int indexSec;		/* ...or once this many seconds have passed */
+	int realtime;		/* Sample from a SCHED_FIFO thread instead of SIGALRM */
+	int rtPriority;		/* SCHED_FIFO priority of that thread (1-99) */
+	int rtCpu;			/* CPU it is pinned to, -1 for no pinning */
+	char exportEndpoint[100];	/* udp:<host>:<port> or unix:<path>, empty to disable */
+	int exportBatch;	/* Largest export datagram in bytes */
+	int exportMsec;		/* Oldest reading held back before a batch is sent */
+	int spoolKb;		/* Bound on batches kept while the collector is down */
+	int trigger;		/* Sample fast, log around threshold crossings only */
+	int triggerMsec;	/* Sampling period while triggered capture is on */
+	int preTrigger;		/* Readings kept in RAM ahead of a trigger */
+	int postTrigger;	/* Readings logged after it */
+	int pThreshold;		/* Set by p_target: */
+	float pTarget, pWindow;		/* Pa (m in altimeter mode) */
+	int tThreshold;		/* Set by t_target: */
+	float tTarget, tWindow;		/* degC */
+	int triggerGpio;	/* GPIO wired to MPL3115A2 INT1, -1 to compare in software */
+};
+static struct leyldOptions options;
+
 /****** Message Loggers ******/
 /* Log Message */
 void logMessage(const char *format,...)
@@ -58,9 +114,11 @@ void logMessage(const char *format,...)
 	char timestamp[TS_BUF_SIZE];
 	time_t t;
 	struct tm *loc;
+	struct tm tmBuf;
 
 	t = time(NULL);
-	loc = localtime(&t);
+	loc = localtime_r(&t, &tmBuf);
+	flockfile(logfp);	/* Keep lines whole when sensor threads log */
 	if (loc == NULL || strftime(timestamp, TS_BUF_SIZE, TIMESTAMP_FMT, loc) == 0)
 		fprintf(logfp, "??Unknown time??: ");
 	else
@@ -70,16 +128,47 @@ void logMessage(const char *format,...)
 	vfprintf(logfp, format, argList);
 	fprintf(logfp, "\n");
 	va_end(argList);
+	funlockfile(logfp);
 }
-void dataLog(const char *format,...)
+/* Offset the next row will be written at in the active data file */
+static uint64_t dataOffset(void)
+{
+	if (durableData.isOpen())
+		return durableData.size();
+	off_t pos = ftello(datafp);
+	return (pos < 0) ? 0 : pos;
+}
+/* Write one csv line to whichever data file is active. The elapsed time is
+ * a double printed to the microsecond, so months into a run it still maps
+ * back to the exact reading time for leylogd-query. */
+static void dataWrite(const double *time_precise, const char *format, va_list argList)
+{
+	if (durableData.isOpen()){
+		char line[DW_MAX_PAYLOAD];
+		int len = 0;
+		if (time_precise != NULL)
+			len = snprintf(line, sizeof(line), "%.6f,", *time_precise);
+		len += vsnprintf(line + len, sizeof(line) - len, format, argList);
+		if (len >= (int)sizeof(line))
+			len = sizeof(line) - 1;
+		durableData.append(CSV_Record, line, len);
+	} else {
+		if (time_precise != NULL)
+			fprintf(datafp,"%.6f,",*time_precise);
+		vfprintf(datafp, format, argList);
+		fprintf(datafp, "\n");
+	}
+}
+/* Elapsed time is measured from the first call, which writes the header.
+ * 'when' is the time of the reading, NULL meaning now. */
+static void vDataLog(const struct timeval *when, const char *format, va_list argList)
 {
-	/* stdarg.h macro */
-	va_list argList;
 	/*Timing*/
 	static struct timeval start;
 	struct timeval curr;
 	static int initial = 0; //Number of calls to this function
-	float time_precise = 0.0;
+	double time_precise = 0.0;
+	uint64_t offset = dataOffset();
 
 	if (initial == 0){
 		//Initialise with header and timer
@@ -89,67 +178,284 @@ void dataLog(const char *format,...)
 			logMessage("Data logging timer started");
 			initial = 1;
 			// dataLog expects a Header on first access
-			va_start(argList, format); /* stdarg.h macro */
-			vfprintf(datafp, format, argList);
-			fprintf(datafp, "\n");
-			va_end(argList);
+			dataWrite(NULL, format, argList);
+			dataIndex.startSegment(TimeIndex::toUsec(&start), offset);
 		}
 	}else {
 		// Normal function
-		if(gettimeofday(&curr, NULL) == -1){
+		if(when != NULL){
+			curr = *when;
+		} else if(gettimeofday(&curr, NULL) == -1){
 			logMessage("Data logging timer failure!");
-		} else {
-			time_precise = curr.tv_sec - start.tv_sec + (curr.tv_usec - start.tv_usec)/1000000.0;
+			curr = start;
 		}
+		time_precise = (double)(curr.tv_sec - start.tv_sec) + (curr.tv_usec - start.tv_usec)/1000000.0;
 		//print to datafile
-		fprintf(datafp,"%f,",time_precise);
-		va_start(argList, format); /* stdarg.h macro */
-		vfprintf(datafp, format, argList);
-		fprintf(datafp, "\n");
-		va_end(argList);
+		dataWrite(&time_precise, format, argList);
+		dataIndex.note(TimeIndex::toUsec(&curr), offset);
 	}
 }
+void dataLog(const char *format,...)
+{
+	va_list argList;
+	va_start(argList, format); /* stdarg.h macro */
+	vDataLog(NULL, format, argList);
+	va_end(argList);
+}
+static void dataLogAt(const struct timeval *when, const char *format,...)
+{
+	va_list argList;
+	va_start(argList, format); /* stdarg.h macro */
+	vDataLog(when, format, argList);
+	va_end(argList);
+}
 /* Open Log file */
-static void logOpen(const char *logFilename, const char *dataFilename)
+static void logOpen(const char *logFilename)
 {
 	mode_t m; /*mode of file*/
 
 	m = umask(077); /* File mode creation mask */
 	logfp = fopen(logFilename, "a");
-	datafp = fopen(dataFilename, "a");
 	umask(m);
 
-	if(logfp == NULL || datafp == NULL){
+	if(logfp == NULL){
 		exit(EXIT_FAILURE);
 	}
 	setbuf(logfp, NULL); /* Disable stdio buffering */
-	setbuf(datafp, NULL); /* Disable stdio buffering */
 
 //	logMessage("Opened log file");
 }
+/* Open the time index beside the data file, a failure only disables it */
+static void indexOpen(const char *dataFilename, const struct leyldOptions *opts)
+{
+	char indexFilename[PATH_MAX];
+	snprintf(indexFilename, sizeof(indexFilename), "%s.idx", dataFilename);
+	if (dataIndex.open(indexFilename, dataOffset(), opts->indexRecords, opts->indexSec) == -1)
+		logMessage("Time indexing disabled");
+}
+/* Open Data file, plain csv or checksummed records depending on options,
+ * its time index, and the raw frame file if asked for (a failure there only
+ * disables it) */
+static void dataOpen(const char *dataFilename, const char *durableFilename,
+		const char *rawFilename, const struct leyldOptions *opts)
+{
+	if (opts->rawLog && rawData.open(rawFilename, opts->syncRecords, opts->syncMsec, opts->preallocKb) == -1)
+		logMessage("Raw frame logging disabled");
+	if (opts->durable){
+		if (durableData.open(durableFilename, opts->syncRecords, opts->syncMsec, opts->preallocKb) == -1){
+			logMessage("Fatal: unable to open durable data file %s",durableFilename);
+			exit(EXIT_FAILURE);
+		}
+		logMessage("Durable data logging (sync every %d records or %d ms)",
+				opts->syncRecords,opts->syncMsec);
+		indexOpen(durableFilename, opts);
+		return;
+	}
+	mode_t m = umask(077); /* File mode creation mask */
+	datafp = fopen(dataFilename, "a");
+	umask(m);
+
+	if(datafp == NULL){
+		logMessage("Fatal: unable to open data file %s",dataFilename);
+		exit(EXIT_FAILURE);
+	}
+	setbuf(datafp, NULL); /* Disable stdio buffering */
+	fseeko(datafp, 0, SEEK_END); /* So ftello() gives row offsets from the start */
+	indexOpen(dataFilename, opts);
+}
+/* Open the exporter, a failure only disables exporting */
+static void exportOpen(const char *spoolFilename, const struct leyldOptions *opts)
+{
+	if (opts->exportEndpoint[0] == '\0')
+		return;
+	if (exporter.open(opts->exportEndpoint, spoolFilename, opts->exportBatch,
+			opts->exportMsec, opts->spoolKb) == -1)
+		logMessage("Exporting disabled");
+}
+/* Queue one reading for the collector, never blocks. Only sensors flagged
+ * in 'valid' (RAW_TMP102, RAW_MPL3115A2) are sent, so error codes and stale
+ * values never reach it; a reading with neither is skipped. */
+static void exportReading(const struct timeval *when, unsigned valid,
+		float temp_tmp102, float pressure_mpl, float temp_mpl)
+{
+	char fields[EXPORT_MAX_LINE];
+	int len = 0;
+	if (!exporter.isOpen() || !(valid & (RAW_TMP102 | RAW_MPL3115A2)))
+		return;
+	if (valid & RAW_TMP102)
+		len = snprintf(fields, sizeof(fields), "temp_tmp102=%f", temp_tmp102);
+	if (valid & RAW_MPL3115A2)
+		snprintf(fields + len, sizeof(fields) - len, "%spressure_mpl=%f,temp_mpl=%f",
+				len ? "," : "", pressure_mpl, temp_mpl);
+	exporter.add(when, fields);
+}
+/* Time until the data files or the exporter next need servicing without a
+ * new reading, -1 for never; see serviceDue() */
+static long msecUntilDue(void)
+{
+	long due[] = {durableData.msecUntilSync(), rawData.msecUntilSync(),
+			exporter.isOpen() ? exporter.msecUntilDue() : -1};
+	long wait = -1;
+	for (unsigned i = 0; i < sizeof(due)/sizeof(due[0]); i++)
+		if (due[i] >= 0 && (wait < 0 || due[i] < wait))
+			wait = due[i];
+	return wait;
+}
+/* Sync records past sync_msec and send aged export batches */
+static void serviceDue(void)
+{
+	durableData.syncIfDue();
+	rawData.syncIfDue();
+	if (exporter.isOpen())
+		exporter.flushIfDue();
+}
 /* Close Log file */
 static void logClose(void)
 {
 	logMessage("Closing log and data file");
+	exporter.close();
+	rawData.close();
+	dataIndex.close();
+	if (durableData.isOpen())
+		durableData.close();
+	if (datafp != NULL)
+		fclose(datafp);
 	fclose(logfp);
-	fclose(datafp);
 }
 /**************************************************************/
 
 /**************** CONFIGURATION HANDLERS **********************/
-static void readConfigFile(const char *configFilename, int *config)
+static void defaultOptions(struct leyldOptions *opts)
+{
+	opts->durable = 0;
+	opts->syncRecords = 64;
+	opts->syncMsec = 10000;
+	opts->preallocKb = 1024;
+	opts->rawLog = 0;
+	opts->indexRecords = 256;
+	opts->indexSec = 3600;
+	opts->realtime = 0;
+	opts->rtPriority = 50;
+	opts->rtCpu = -1;
+	opts->exportEndpoint[0] = '\0';
+	opts->exportBatch = 1400;
+	opts->exportMsec = 1000;
+	opts->spoolKb = 1024;
+	opts->trigger = 0;
+	opts->triggerMsec = 100;
+	opts->preTrigger = 300;
+	opts->postTrigger = 600;
+	opts->pThreshold = 0;
+	opts->pTarget = opts->pWindow = 0;
+	opts->tThreshold = 0;
+	opts->tTarget = opts->tWindow = 0;
+	opts->triggerGpio = -1;
+}
+/* Recognised "<key>: <value>" lines after the timer line:
+ *	durable: <0|1>			checksummed records in leyld.dat (restart to change)
+ *	sync_records: <int>		durable: fdatasync() after this many records
+ *	sync_msec: <int>		durable: or after this many milliseconds
+ *	prealloc_kb: <int>		durable: fallocate() step in KiB, 0 disables
+ *	raw_log: <0|1>			raw register frames in leyld.raw (restart to change),
+ *							synced like durable
+ *	index_records: <int>	time index entry every this many data rows...
+ *	index_sec: <int>		...or this many seconds, 0 disables either bound
+ *	realtime: <0|1>			SCHED_FIFO sampling thread (restart to change)
+ *	rt_priority: <1-99>		realtime: thread priority
+ *	rt_cpu: <int>			realtime: CPU to pin the thread to, -1 for any
+ *	export: <endpoint>		udp:<host>:<port> or unix:<path> (restart to change)
+ *	export_batch: <bytes>	export: datagram size limit
+ *	export_msec: <int>		export: send once the oldest reading is this old
+ *	spool_kb: <int>			export: spool bound while the collector is down
+ *	trigger: <0|1>			triggered burst capture (restart to change), the
+ *							timer line becomes the background logging rate
+ *	trigger_msec: <int>		trigger: sampling period in milliseconds
+ *	pre_trigger: <int>		trigger: readings kept from before a trigger
+ *	post_trigger: <int>		trigger: readings logged after it
+ *	p_target: <Pa>			trigger: pressure threshold...
+ *	p_window: <Pa>			...and window around it, 0 for the target alone
+ *	t_target: <degC>		trigger: temperature threshold...
+ *	t_window: <degC>		...and window around it
+ *	trigger_gpio: <int>		trigger: GPIO wired to MPL3115A2 INT1, -1 compares
+ *							readings in software (restart to change) */
+static void setOption(struct leyldOptions *opts, const char *key, const char *value)
+{
+	if (strcmp(key, "durable") == 0)
+		opts->durable = atoi(value);
+	else if (strcmp(key, "sync_records") == 0)
+		opts->syncRecords = atoi(value);
+	else if (strcmp(key, "sync_msec") == 0)
+		opts->syncMsec = atoi(value);
+	else if (strcmp(key, "prealloc_kb") == 0)
+		opts->preallocKb = atoi(value);
+	else if (strcmp(key, "raw_log") == 0)
+		opts->rawLog = atoi(value);
+	else if (strcmp(key, "index_records") == 0)
+		opts->indexRecords = atoi(value);
+	else if (strcmp(key, "index_sec") == 0)
+		opts->indexSec = atoi(value);
+	else if (strcmp(key, "realtime") == 0)
+		opts->realtime = atoi(value);
+	else if (strcmp(key, "rt_priority") == 0)
+		opts->rtPriority = atoi(value);
+	else if (strcmp(key, "rt_cpu") == 0)
+		opts->rtCpu = atoi(value);
+	else if (strcmp(key, "export") == 0){
+		strncpy(opts->exportEndpoint, value, sizeof(opts->exportEndpoint) - 1);
+		opts->exportEndpoint[sizeof(opts->exportEndpoint) - 1] = '\0';
+	}
+	else if (strcmp(key, "export_batch") == 0)
+		opts->exportBatch = atoi(value);
+	else if (strcmp(key, "export_msec") == 0)
+		opts->exportMsec = atoi(value);
+	else if (strcmp(key, "spool_kb") == 0)
+		opts->spoolKb = atoi(value);
+	else if (strcmp(key, "trigger") == 0)
+		opts->trigger = atoi(value);
+	else if (strcmp(key, "trigger_msec") == 0)
+		opts->triggerMsec = atoi(value);
+	else if (strcmp(key, "pre_trigger") == 0)
+		opts->preTrigger = atoi(value);
+	else if (strcmp(key, "post_trigger") == 0)
+		opts->postTrigger = atoi(value);
+	else if (strcmp(key, "p_target") == 0){
+		opts->pTarget = atof(value);
+		opts->pThreshold = 1;
+	}
+	else if (strcmp(key, "p_window") == 0)
+		opts->pWindow = atof(value);
+	else if (strcmp(key, "t_target") == 0){
+		opts->tTarget = atof(value);
+		opts->tThreshold = 1;
+	}
+	else if (strcmp(key, "t_window") == 0)
+		opts->tWindow = atof(value);
+	else if (strcmp(key, "trigger_gpio") == 0)
+		opts->triggerGpio = atoi(value);
+	else
+		logMessage("Unknown configuration key \"%s\"", key);
+}
+static void readConfigFile(const char *configFilename, int *config, struct leyldOptions *opts)
 {
 	FILE *configfp;
 #define SBUF_SIZE 100
 	char str[SBUF_SIZE];
+	char key[SBUF_SIZE], value[SBUF_SIZE];
 
+	defaultOptions(opts);
 	configfp = fopen(configFilename, "r");
 	if(configfp != NULL && fgets(str, SBUF_SIZE, configfp) != NULL) {	/* Ignore nonexistent file */
 		sscanf(str,"%*s %d%*c %*s %d",&config[0],&config[1]);
 		logMessage("Read config file: %d, %d", config[0],config[1]);
+		while (fgets(str, SBUF_SIZE, configfp) != NULL) {
+			if (sscanf(str, " %99[^:#]: %99s", key, value) == 2)
+				setOption(opts, key, value);
+		}
 		fclose(configfp);
 	} else {
 		logMessage("Couldn't open and/or read configuration file");
+		if (configfp != NULL)
+			fclose(configfp);
 		//Defaults
 		config[0] = 30;
 		config[1] = 1;
@@ -170,6 +476,468 @@ static int setTimer(struct itimerval *itv, int *config)
 		return 0;
 	}
 }
+static long configPeriodUs(const int *config)
+{
+	return config[0]*1000000L + config[1];
+}
+/**************************************************************/
+
+/**************************** READINGS ************************/
+struct leyldSample {
+	struct timeval when;		/* Wall clock time of the reading */
+	long long latencyNs;		/* Real-time: wake-up lateness against the schedule */
+	unsigned long missed;		/* Real-time: whole periods skipped before this wake-up */
+	float temp_tmp102, pressure_mpl, temp_mpl;
+	int tmp102Error, mplError;	/* readRaw() codes, 0 for a good read */
+	int interrupt;				/* Real-time: INT1 fired, intSource read after it */
+	int intSource;				/* INT_SOURCE, -1 if it couldn't be read */
+	struct RawReading raw;		/* Register bytes the values were converted from */
+};
+
+/* Read both sensors once. Only the sensors flagged in raw.valid hold a
+ * fresh value; a failed read leaves the previous one in place. */
+static void takeReading(TMP102 *tmp102, MPL3115A2_Altimeter *altimeter, struct leyldSample *sample)
+{
+	struct RawReading *raw = &sample->raw;
+
+	gettimeofday(&sample->when, NULL);
+	memset(raw, 0, sizeof(*raw));
+	raw->sec = sample->when.tv_sec;
+	raw->usec = sample->when.tv_usec;
+	raw->mplState = altimeter->state();
+	if ((sample->tmp102Error = tmp102->readRaw(raw->tmp102)) == 0){
+		raw->valid |= RAW_TMP102;
+		sample->temp_tmp102 = TMP102::convertTemperature(raw->tmp102[0], raw->tmp102[1]);
+	}
+	if ((sample->mplError = altimeter->readRaw(raw->mpl3115a2)) == 0){
+		raw->valid |= RAW_MPL3115A2;
+		MPL3115A2_Altimeter::convertData(raw->mpl3115a2, altimeter->state(),
+				&sample->pressure_mpl, &sample->temp_mpl);
+	}
+}
+
+/* Data file, raw frame file and exporter (main thread only). Columns of a
+ * sensor that failed to read are left empty, as leylogd-replay does. */
+static void logReading(const struct leyldSample *sample)
+{
+	char tmp102[16] = "", mpl[32] = ",";
+	if (sample->raw.valid & RAW_TMP102)
+		snprintf(tmp102, sizeof(tmp102), "%f", sample->temp_tmp102);
+	if (sample->raw.valid & RAW_MPL3115A2)
+		snprintf(mpl, sizeof(mpl), "%f,%f", sample->pressure_mpl, sample->temp_mpl);
+	dataLogAt(&sample->when, "%s,%s", tmp102, mpl);
+	if (rawData.isOpen())
+		rawData.append(Raw_Frame, &sample->raw, sizeof(sample->raw));
+	exportReading(&sample->when, sample->raw.valid, sample->temp_tmp102,
+			sample->pressure_mpl, sample->temp_mpl);
+}
+/**************************************************************/
+
+/************************ TRIGGERED CAPTURE *******************/
+/* With trigger: 1 the sensors are read every trigger_msec and each reading
+ * waits in a RAM ring holding the last pre_trigger of them. A reading that
+ * leaves the ring is only logged if the background period (the timer line
+ * of leyld.conf) has passed since the last logged one. A threshold crossing,
+ * seen by comparing readings in software or as the MPL3115A2 interrupt on a
+ * GPIO, writes out the whole ring and then every reading for post_trigger
+ * more. Everything goes through logReading() oldest first, so the data file
+ * stays in time order; background rows lag by the length of the ring. */
+#define TRIGGER_RING_SIZE	4096	/* Upper bound on pre_trigger */
+
+struct burstCapture {
+	long backgroundUs;			/* Period of rows logged outside bursts */
+	struct timeval lastLogged;
+	int band[2];				/* Pressure/temperature band of the last reading, -1 unknown */
+	unsigned head;				/* Next slot to fill */
+	unsigned count;				/* Readings waiting in the ring */
+	int postRemaining;			/* Readings still to log for the current burst */
+	unsigned long bursts;
+	struct leyldSample ring[TRIGGER_RING_SIZE];
+};
+static struct burstCapture burst;
+
+/* Timer line of leyld.conf, or trigger_msec when it only sets the background rate */
+static void samplingPeriod(const int *config, const struct leyldOptions *opts, int *sampling)
+{
+	if (opts->trigger && opts->triggerMsec > 0){
+		sampling[0] = opts->triggerMsec/1000;
+		sampling[1] = (opts->triggerMsec%1000)*1000;
+	} else {
+		sampling[0] = config[0];
+		sampling[1] = config[1];
+	}
+}
+
+static int preTriggerReadings(void)
+{
+	if (options.preTrigger < 0)
+		return 0;
+	return (options.preTrigger > TRIGGER_RING_SIZE) ? TRIGGER_RING_SIZE : options.preTrigger;
+}
+
+/* 0 below the window, 1 inside it, 2 above; a zero window is just the target */
+static int thresholdBand(float value, float target, float window)
+{
+	if (value < target - window)
+		return 0;
+	return (window > 0 && value <= target + window) ? 1 : 2;
+}
+
+/* Returns what was crossed, NULL if neither threshold was */
+static const char *softwareTrigger(const struct leyldSample *sample)
+{
+	static char cause[128];
+	int band;
+
+	if (!(sample->raw.valid & RAW_MPL3115A2))
+		return NULL;
+	cause[0] = '\0';
+	if (options.pThreshold){
+		band = thresholdBand(sample->pressure_mpl, options.pTarget, options.pWindow);
+		if (burst.band[0] != -1 && band != burst.band[0])
+			snprintf(cause, sizeof(cause), "pressure %.1f crossed %.1f +/- %.1f",
+					sample->pressure_mpl, options.pTarget, options.pWindow);
+		burst.band[0] = band;
+	}
+	if (options.tThreshold){
+		band = thresholdBand(sample->temp_mpl, options.tTarget, options.tWindow);
+		if (burst.band[1] != -1 && band != burst.band[1] && cause[0] == '\0')
+			snprintf(cause, sizeof(cause), "temperature %.2f crossed %.2f +/- %.2f",
+					sample->temp_mpl, options.tTarget, options.tWindow);
+		burst.band[1] = band;
+	}
+	return cause[0] ? cause : NULL;
+}
+
+static void logCaptured(const struct leyldSample *sample)
+{
+	logReading(sample);
+	burst.lastLogged = sample->when;
+}
+
+static int backgroundDue(const struct leyldSample *sample)
+{
+	long long sinceUs = (sample->when.tv_sec - burst.lastLogged.tv_sec)*1000000LL
+			+ (sample->when.tv_usec - burst.lastLogged.tv_usec);
+	return burst.lastLogged.tv_sec == 0 || sinceUs >= burst.backgroundUs;
+}
+
+/* Drop the oldest reading, logging it if a background row is due */
+static void evictOldest(void)
+{
+	const struct leyldSample *oldest = &burst.ring[(burst.head - burst.count) % TRIGGER_RING_SIZE];
+	if (backgroundDue(oldest))
+		logCaptured(oldest);
+	burst.count--;
+}
+
+/* Events are what this mode is for, don't leave them in cache */
+static void syncCaptured(void)
+{
+	if (durableData.isOpen())
+		durableData.sync();
+	if (rawData.isOpen())
+		rawData.sync();
+}
+
+/* Start (or extend) a burst: write out the pre-trigger window */
+static void triggerBurst(const char *cause)
+{
+	if (burst.postRemaining == 0){
+		burst.bursts++;
+		logMessage("Trigger: %s, writing %u pre-trigger readings", cause, burst.count);
+	}
+	while (burst.count > 0){
+		logCaptured(&burst.ring[(burst.head - burst.count) % TRIGGER_RING_SIZE]);
+		burst.count--;
+	}
+	burst.postRemaining = (options.postTrigger > 0) ? options.postTrigger : 0;
+	syncCaptured();
+}
+
+/* Every reading goes through here (main thread only) */
+static void captureReading(const struct leyldSample *sample)
+{
+	const char *cause;
+
+	if (!options.trigger){
+		logReading(sample);
+		return;
+	}
+	if (options.triggerGpio < 0 && (cause = softwareTrigger(sample)) != NULL)
+		triggerBurst(cause);
+	if (burst.postRemaining > 0){
+		logCaptured(sample);
+		if (--burst.postRemaining == 0){
+			syncCaptured();
+			logMessage("Trigger: burst %lu complete", burst.bursts);
+		}
+		return;
+	}
+	int pre = preTriggerReadings();
+	while (burst.count > 0 && (int)burst.count >= pre)
+		evictOldest();
+	if (pre == 0){
+		if (backgroundDue(sample))	/* Nothing is kept ahead of a trigger */
+			logCaptured(sample);
+		return;
+	}
+	burst.ring[(burst.head++) % TRIGGER_RING_SIZE] = *sample;
+	burst.count++;
+}
+
+/* MPL3115A2 INT1 fired and INT_SOURCE has been read, which clears the latched
+ * threshold flags so INT1 can rise again for the next crossing. Without
+ * realtime the main thread reads it; with it the sampling thread owns the
+ * bus, reads it before its next reading and hands it over in that reading
+ * (see drainSamples()). */
+static void hardwareTrigger(int source)
+{
+	char cause[64];
+
+	if (source >= 0)
+		snprintf(cause, sizeof(cause), "MPL3115A2 INT1 (INT_SOURCE %02x)", source);
+	else
+		snprintf(cause, sizeof(cause), "MPL3115A2 INT1, INT_SOURCE unreadable");
+	triggerBurst(cause);
+}
+
+/* Program the device thresholds and open the GPIO; returns the descriptor,
+ * or -1 with options.triggerGpio cleared so readings are compared instead */
+static int triggerOpen(MPL3115A2_Altimeter *altimeter, int altimeterHealthy, const int *config)
+{
+	int fd = -1;
+
+	burst.backgroundUs = configPeriodUs(config);
+	burst.band[0] = burst.band[1] = -1;
+	if (options.triggerGpio >= 0){
+		if (altimeterHealthy && altimeter->setThresholds(options.pThreshold, options.pTarget,
+				options.pWindow, options.tThreshold, options.tTarget, options.tWindow) == 0)
+			fd = gpioOpenEdge(options.triggerGpio, "rising");
+		if (fd == -1){
+			logMessage("Trigger: MPL3115A2 interrupt unavailable, comparing readings instead");
+			options.triggerGpio = -1;
+		}
+	}
+	if (!options.pThreshold && !options.tThreshold)
+		logMessage("Trigger: no p_target or t_target set, only background rows will be logged");
+	logMessage("Triggered capture every %d ms, %d readings before and %d after a trigger",
+			options.triggerMsec, preTriggerReadings(), options.postTrigger);
+	return fd;
+}
+
+/* Log whatever background rows are still waiting in the ring */
+static void triggerClose(int gpioFd)
+{
+	while (burst.count > 0)
+		evictOldest();
+	logMessage("Trigger: %lu bursts captured", burst.bursts);
+	gpioClose(gpioFd);
+}
+/**************************************************************/
+
+/************************ REAL-TIME ACQUISITION ***************/
+/* With realtime: 1 the sensors are read by a SCHED_FIFO thread sleeping on
+ * absolute CLOCK_MONOTONIC deadlines. Readings go through a fixed ring to
+ * the main thread, which is woken with SIGALRM and does all file I/O, so
+ * nothing on the sampling path allocates, takes a lock or touches disk.
+ * The drivers are quiet there: read failures travel in the reading and
+ * are logged by the main thread. */
+#define RT_RING_SIZE		256		/* Readings buffered between the two threads */
+#define RT_REPORT_SAMPLES	1000	/* Log jitter statistics this often */
+
+struct acquisition {
+	TMP102 *tmp102;
+	MPL3115A2_Altimeter *altimeter;
+	pthread_t mainThread;			/* Woken with SIGALRM for each reading */
+	pthread_t thread;
+	volatile long periodUs;			/* Updated by the main thread on SIGHUP */
+	volatile unsigned head;			/* Written by the sampling thread only */
+	volatile unsigned tail;			/* Written by the main thread only */
+	volatile unsigned long dropped;	/* Readings lost to a full ring */
+	volatile int intSourceWanted;	/* Set by the main thread when INT1 fires */
+	struct leyldSample ring[RT_RING_SIZE];
+};
+static struct acquisition rtAcq;
+static struct rtJitter rtStats;
+static unsigned long rtDroppedReported = 0;
+
+static void *acquisitionThread(void *arg)
+{
+	struct acquisition *acq = (struct acquisition *)arg;
+	struct timespec next, now;
+	struct leyldSample reading;	/* Carries values over a failed read */
+
+	rtPrefaultStack(RT_STACK_PREFAULT);
+	/* Only allow cancellation while asleep, never mid I2C transfer */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	memset(&reading, 0, sizeof(reading));
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for(;;){
+		long long periodNs = acq->periodUs*1000LL;
+		timespecAddNs(&next, periodNs);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long long late = timespecDiffNs(&now, &next);
+		unsigned long missed = 0;
+		if (late >= periodNs){	/* Overran: skip whole periods rather than bursting */
+			missed = late/periodNs;
+			timespecAddNs(&next, missed*periodNs);
+			late -= missed*periodNs;
+		}
+
+		unsigned head = acq->head;
+		if (head - acq->tail >= RT_RING_SIZE){
+			acq->dropped++;
+			continue;
+		}
+		/* Clear the INT1 latch first, so the reading carrying it is the
+		 * first one taken after the crossing */
+		if ((reading.interrupt = __sync_lock_test_and_set(&acq->intSourceWanted, 0)))
+			reading.intSource = acq->altimeter->readInterruptSource();
+		takeReading(acq->tmp102, acq->altimeter, &reading);
+		reading.latencyNs = late;
+		reading.missed = missed;
+		acq->ring[head % RT_RING_SIZE] = reading;
+		__sync_synchronize();	/* Publish the reading before the index */
+		acq->head = head + 1;
+		pthread_kill(acq->mainThread, SIGALRM);
+	}
+	return NULL;
+}
+
+/* Log every reading the sampling thread has published (main thread only) */
+static void drainSamples(struct acquisition *acq)
+{
+	while (acq->tail != acq->head){
+		__sync_synchronize();	/* Read the index before the reading */
+		struct leyldSample *sample = &acq->ring[acq->tail % RT_RING_SIZE];
+		rtJitterAdd(&rtStats, sample->latencyNs, sample->missed);
+		if (sample->tmp102Error)
+			logMessage("Real-time: TMP102 read failed (%s)", TMP102::readError(sample->tmp102Error));
+		if (sample->mplError)
+			logMessage("Real-time: MPL3115A2 read failed (%s)",
+					MPL3115A2_Altimeter::readError(sample->mplError));
+		if (sample->interrupt)
+			hardwareTrigger(sample->intSource);
+		captureReading(sample);
+		__sync_synchronize();	/* Finish with the slot before releasing it */
+		acq->tail = acq->tail + 1;
+		if (rtStats.samples % RT_REPORT_SAMPLES == 0)
+			rtJitterReport(&rtStats, acq->periodUs*1000LL);
+	}
+	if (acq->dropped != rtDroppedReported){
+		rtDroppedReported = acq->dropped;
+		logMessage("Real-time: %lu readings dropped, logging is falling behind", rtDroppedReported);
+	}
+}
+
+/* Lock memory, hold the I2C descriptors open and start the sampling thread.
+ * Returns -1 (and leaves the timer path in charge) if any step fails. */
+static int startAcquisition(struct acquisition *acq, TMP102 *tmp102,
+		MPL3115A2_Altimeter *altimeter, const int *config, const struct leyldOptions *opts)
+{
+	sigset_t all, prev;
+	int err;
+
+	acq->tmp102 = tmp102;
+	acq->altimeter = altimeter;
+	acq->mainThread = pthread_self();
+	acq->periodUs = configPeriodUs(config);
+	acq->head = acq->tail = 0;
+	acq->dropped = 0;
+	acq->intSourceWanted = 0;
+	memset(acq->ring, 0, sizeof(acq->ring));	/* Prefault the ring */
+	rtJitterReset(&rtStats);
+
+	if (acq->periodUs <= 0){
+		logMessage("Real-time: invalid sampling period");
+		return -1;
+	}
+	if (tmp102->keepBusOpen() == -1 || altimeter->keepBusOpen() == -1)
+		return -1;
+	if (rtLockMemory() == -1)
+		return -1;
+
+	tmp102->setQuiet(1);
+	altimeter->setQuiet(1);
+	sigfillset(&all);	/* Signals stay with the main thread */
+	pthread_sigmask(SIG_SETMASK, &all, &prev);
+	err = rtStartThread(&acq->thread, acquisitionThread, acq, opts->rtPriority, opts->rtCpu);
+	pthread_sigmask(SIG_SETMASK, &prev, NULL);
+	if (err != 0){
+		tmp102->setQuiet(0);
+		altimeter->setQuiet(0);
+		return -1;
+	}
+	logMessage("Real-time sampling every %ld us (SCHED_FIFO %d, cpu %d)",
+			acq->periodUs, opts->rtPriority, opts->rtCpu);
+	return 0;
+}
+
+static void stopAcquisition(struct acquisition *acq)
+{
+	pthread_cancel(acq->thread);
+	pthread_join(acq->thread, NULL);
+	drainSamples(acq);
+	rtJitterReport(&rtStats, acq->periodUs*1000LL);
+}
+/**************************************************************/
+
+/**************************** SENSOR PROBING ******************/
+struct sensorProbe {
+	const char *name;
+	void *(*probe)(void *);
+	void *sensor;
+	pthread_t thread;
+	int started;
+	int status;		/* 0 when the device answered and was configured */
+};
+
+static void *probeTMP102(void *sensor)
+{
+	return (void *)(long)((TMP102 *)sensor)->initialise();
+}
+static void *probeMPL3115A2(void *sensor)
+{
+	return (void *)(long)((MPL3115A2_Altimeter *)sensor)->initialise();
+}
+
+/* Configure every sensor on its own thread so that one absent device's bus
+ * timeouts don't hold up the others. Signals are blocked in the probe
+ * threads so the timer can't interrupt their I2C transfers. Returns the
+ * number of healthy sensors and writes a one line summary into status. */
+static int probeSensors(struct sensorProbe *probes, int n, char *status, size_t len)
+{
+	sigset_t all, prev;
+	int i, healthy = 0;
+	size_t used = 0;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &prev);
+	for (i = 0; i < n; i++)
+		probes[i].started = (pthread_create(&probes[i].thread, NULL, probes[i].probe, probes[i].sensor) == 0);
+	pthread_sigmask(SIG_SETMASK, &prev, NULL);
+
+	for (i = 0; i < n; i++) {
+		void *result = (void *)-1L;
+		if (probes[i].started)
+			pthread_join(probes[i].thread, &result);
+		else
+			result = probes[i].probe(probes[i].sensor);	/* No thread, probe inline */
+		probes[i].status = (int)(long)result;
+		if (probes[i].status == 0)
+			healthy++;
+		if (used < len)
+			used += snprintf(status + used, len - used, "%s%s %s", i ? ", " : "",
+					probes[i].name, probes[i].status == 0 ? "ok" : "FAILED");
+	}
+	return healthy;
+}
 /**************************************************************/
 
 /**************************** INTERRUPT HANDLERS **************/
@@ -217,14 +985,19 @@ int main(int argc, char *argv[])
 	sigaction(SIGALRM, &act, NULL);// catch timer alarm
 
 /* Set up Daemon Process */
-	if(becomeDaemon(0) == -1){
+	/* Under systemd (Type=notify) stay in the foreground and report readiness
+	 * on $NOTIFY_SOCKET instead of double forking */
+	int daemonFlags = (getenv("NOTIFY_SOCKET") != NULL) ? BD_NO_FORK : 0;
+	if(becomeDaemon(daemonFlags) == -1){
 		exit(EXIT_FAILURE);
 	}
 
 /* Open Log file */
 	int config[2];
-	logOpen(LOG_FILE,DATA_FILE);
-	readConfigFile(CONFIG_FILE,config);
+	logOpen(LOG_FILE);
+	readConfigFile(CONFIG_FILE,config,&options);
+	dataOpen(DATA_FILE,DURABLE_FILE,RAW_FILE,&options);
+	exportOpen(SPOOL_FILE,&options);
 	int count;
 	if (argc > 1){
 		for(count = 1; count < argc; count++){
@@ -232,48 +1005,165 @@ int main(int argc, char *argv[])
 		}
 	}
 
-/* Set up Timers */
-	struct itimerval itv;
-	/* Set timer values*/
-	if(setTimer(&itv,config) == -1){
-		logMessage("Fatal Timer error!");
-		exit(EXIT_FAILURE);
-	}
 	dataLog("Time,Temperature_TMP102,Pressure_MPL,Temperature_MPL"); // Write header to data csv file;
 
 /* Initialise TMP102 Sensor */
 	TMP102 TempSensor1(I2C1, Ground, Default_MSB, CR_8Hz_13bit);
 /* Initialise MPL3115A2 Sensor */
 	MPL3115A2_Altimeter altimeter(I2C1,Standard,Barometer);
+	struct sensorProbe probes[] = {
+		{"TMP102", probeTMP102, &TempSensor1, pthread_t(), 0, -1},
+		{"MPL3115A2", probeMPL3115A2, &altimeter, pthread_t(), 0, -1}
+	};
+	char sensorStatus[128];
+	char notifyState[sizeof(sensorStatus) + 32];
+	int healthy = probeSensors(probes, sizeof(probes)/sizeof(probes[0]), sensorStatus, sizeof(sensorStatus));
+
+/* Triggered capture samples at trigger_msec, the timer line sets the background rate */
+	int triggerFd = -1;
+	if(options.trigger)
+		triggerFd = triggerOpen(&altimeter, probes[1].status == 0 /* MPL3115A2 */, config);
+	int sampling[2];
+	samplingPeriod(config, &options, sampling);
+
+/* Set up Timers */
+	struct itimerval itv;
+	if(options.realtime && startAcquisition(&rtAcq,&TempSensor1,&altimeter,sampling,&options) == -1){
+		logMessage("Real-time sampling unavailable, using the interval timer");
+		options.realtime = 0;
+	}
+	/* Set timer values*/
+	if(!options.realtime && setTimer(&itv,sampling) == -1){
+		logMessage("Fatal Timer error!");
+		exit(EXIT_FAILURE);
+	}
 
 	/* Final Message b4 loop*/
-	logMessage("Initialised");
-	float temp_tmp102, temp_mpl, pressure_mpl;
+	logMessage("Initialised (%d/%d sensors healthy: %s)", healthy,
+			(int)(sizeof(probes)/sizeof(probes[0])), sensorStatus);
+	snprintf(notifyState, sizeof(notifyState), "READY=1\nSTATUS=%s", sensorStatus);
+	daemonNotify(notifyState);
+	struct leyldSample reading;
+	memset(&reading, 0, sizeof(reading));
+
+	/* Signals are only taken while waiting in ppoll(), so none can slip in
+	 * between checking the flags and going to sleep */
+	sigset_t handled, waitMask;
+	sigemptyset(&handled);
+	sigaddset(&handled, SIGHUP);
+	sigaddset(&handled, SIGTERM);
+	sigaddset(&handled, SIGINT);
+	sigaddset(&handled, SIGALRM);
+	sigprocmask(SIG_BLOCK, &handled, &waitMask);
+	struct pollfd gpioPoll = {triggerFd, POLLPRI, 0};
 
 	for(;;){ /*ever*/
 		if(termReceived != 0){
 			/* Close Program [SIGTERM || SIGINT] */
 			termReceived = 0;
+			daemonNotify("STOPPING=1");
+			if(options.realtime)
+				stopAcquisition(&rtAcq);
+			if(options.trigger)
+				triggerClose(triggerFd);
 			logClose();
 			exit(EXIT_SUCCESS);
 		}else if(alrmReceived != 0){
 			/* Data Logging [SIGALRM]*/
-			temp_tmp102 = TempSensor1.readTemperature(); // TODO Change to pointer input;
-			altimeter.readSensor(&pressure_mpl,&temp_mpl);
-			dataLog("%f,%f,%f",temp_tmp102,pressure_mpl,temp_mpl);
 			alrmReceived = 0;
+			if(options.realtime){
+				/* Readings already taken by the sampling thread */
+				drainSamples(&rtAcq);
+			}else{
+				takeReading(&TempSensor1,&altimeter,&reading);
+				captureReading(&reading);
+			}
 		}else if(hupReceived != 0){
 			/* Re-initialise parameters [SIGHUP] */
 			logMessage("Hang-up Received");
-			readConfigFile(CONFIG_FILE,config);
+			daemonNotify("RELOADING=1");
+			struct leyldOptions reloaded;
+			readConfigFile(CONFIG_FILE,config,&reloaded);
 			// Reinitialise Parameters
-			if(setTimer(&itv,config) == -1){
+			if (reloaded.durable != options.durable)
+				logMessage("durable: change ignored until restart");
+			reloaded.durable = options.durable;
+			if (reloaded.rawLog != options.rawLog)
+				logMessage("raw_log: change ignored until restart");
+			reloaded.rawLog = options.rawLog;
+			if (reloaded.realtime != options.realtime || reloaded.rtPriority != options.rtPriority
+					|| reloaded.rtCpu != options.rtCpu)
+				logMessage("realtime: changes ignored until restart");
+			reloaded.realtime = options.realtime;
+			reloaded.rtPriority = options.rtPriority;
+			reloaded.rtCpu = options.rtCpu;
+			if (strcmp(reloaded.exportEndpoint, options.exportEndpoint) != 0)
+				logMessage("export: change ignored until restart");
+			memcpy(reloaded.exportEndpoint, options.exportEndpoint, sizeof(reloaded.exportEndpoint));
+			if (reloaded.trigger != options.trigger || reloaded.triggerGpio != options.triggerGpio)
+				logMessage("trigger: changes ignored until restart");
+			reloaded.trigger = options.trigger;
+			reloaded.triggerGpio = options.triggerGpio;
+			if (options.triggerGpio >= 0 && (reloaded.pThreshold != options.pThreshold
+					|| reloaded.pTarget != options.pTarget || reloaded.pWindow != options.pWindow
+					|| reloaded.tThreshold != options.tThreshold
+					|| reloaded.tTarget != options.tTarget || reloaded.tWindow != options.tWindow)){
+				/* The sampling thread owns the bus, reprogram only from the timer path */
+				if (options.realtime || altimeter.setThresholds(reloaded.pThreshold, reloaded.pTarget,
+						reloaded.pWindow, reloaded.tThreshold, reloaded.tTarget, reloaded.tWindow) == -1){
+					logMessage("Trigger: MPL3115A2 thresholds unchanged until restart");
+					reloaded.pThreshold = options.pThreshold;
+					reloaded.pTarget = options.pTarget;
+					reloaded.pWindow = options.pWindow;
+					reloaded.tThreshold = options.tThreshold;
+					reloaded.tTarget = options.tTarget;
+					reloaded.tWindow = options.tWindow;
+				}
+			}
+			options = reloaded;
+			burst.backgroundUs = configPeriodUs(config);
+			burst.band[0] = burst.band[1] = -1;	/* Thresholds may have moved */
+			samplingPeriod(config, &options, sampling);
+			durableData.setSyncPolicy(options.syncRecords,options.syncMsec);
+			rawData.setSyncPolicy(options.syncRecords,options.syncMsec);
+			dataIndex.setPolicy(options.indexRecords,options.indexSec);
+			if (exporter.isOpen()){
+				exporter.setBatchPolicy(options.exportBatch,options.exportMsec);
+				exporter.report();
+			}
+			if(options.realtime){
+				rtJitterReport(&rtStats, rtAcq.periodUs*1000LL);
+				if(configPeriodUs(sampling) > 0)
+					rtAcq.periodUs = configPeriodUs(sampling);
+			}else if(setTimer(&itv,sampling) == -1){
 				logMessage("Fatal Timer error!");
 				exit(EXIT_FAILURE);
 			}
+			daemonNotify("READY=1");
 			hupReceived = 0;
+		}else if(triggerFd >= 0 && (gpioPoll.revents & POLLPRI)){
+			/* Threshold interrupt [MPL3115A2 INT1] */
+			gpioPoll.revents = 0;
+			gpioAcknowledge(triggerFd);
+			if(options.realtime)
+				rtAcq.intSourceWanted = 1;	/* Read with the next reading */
+			else
+				hardwareTrigger(altimeter.readInterruptSource());
 		}else{
-			pause(); /* suspend until a signal is received.*/
+			/* suspend until a signal is received, INT1 fires, an export
+			 * batch is due or sync_msec runs out on unsynced records */
+			struct timespec timeout, *wait = NULL;
+			long due = msecUntilDue();
+			if (due >= 0){
+				timeout.tv_sec = due/1000;
+				timeout.tv_nsec = (due%1000)*1000000L;
+				wait = &timeout;
+			}
+			int ready = ppoll(&gpioPoll, triggerFd >= 0 ? 1 : 0, wait, &waitMask);
+			if (ready == 0)
+				serviceDue();
+			else if (ready == -1)
+				gpioPoll.revents = 0;
 		}
 	}
 	exit(EXIT_SUCCESS);
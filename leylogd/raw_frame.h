@@ -0,0 +1,39 @@
+//============================================================================
+// Name        	: raw_frame.h
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.4
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Raw register frame layout header file
+// Notes		: With raw_log: 1 every reading is also stored, before any
+//				:  conversion, as a Raw_Frame record in /var/log/leyld.raw so
+//				:  that leylogd-replay can regenerate the csv with the
+//				:  current TMP102/MPL3115A2 conversion code. Fixed width,
+//				:  little endian (as written on the Beaglebone).
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#ifndef RAW_FRAME_H_
+#define RAW_FRAME_H_
+
+#include <stdint.h>
+#include "TMP102.h"
+#include "MPL3115A2_Altimeter.h"
+
+/* Bit-mask values for RawReading.valid */
+#define RAW_TMP102		01		/* tmp102[] holds a successful read */
+#define RAW_MPL3115A2	02		/* mpl3115a2[] holds a successful read */
+
+struct RawReading {
+	uint32_t sec;		/* Wall clock time of the reading */
+	uint32_t usec;
+	uint8_t valid;
+	uint8_t mplState;	/* STATE the MPL3115A2 was read in */
+	uint8_t tmp102[TMP102_I2C_BUFFER];
+	uint8_t mpl3115a2[MPL3115A2_RAW_BYTES];
+	uint8_t reserved[3];
+};
+
+#endif /* RAW_FRAME_H_ */
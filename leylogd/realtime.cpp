@@ -0,0 +1,120 @@
+//============================================================================
+// Name        	: realtime.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.2
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Real-time acquisition helpers definition file
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+
+#include "realtime.h"
+#include <alloca.h>
+#include <errno.h>
+#include <malloc.h>
+#include <math.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+extern void logMessage(const char *format,...); //error reporting
+
+/* Lock current and future pages and stop glibc from handing heap memory back
+ * to the kernel, so nothing on the sampling path page faults. */
+int rtLockMemory(void)
+{
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+		logMessage("Real-time: mlockall failed (%s)", strerror(errno));
+		return -1;
+	}
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	rtPrefaultStack(RT_STACK_PREFAULT);
+	return 0;
+}
+
+/* Touch the next 'bytes' of stack so the pages are resident before use */
+void rtPrefaultStack(size_t bytes)
+{
+	volatile char *stack = (volatile char *)alloca(bytes);
+	for (size_t i = 0; i < bytes; i += 1024)
+		stack[i] = 0;
+}
+
+/* Start 'start' on a SCHED_FIFO thread at 'priority', pinned to 'cpu' unless
+ * cpu < 0. Returns 0 or the pthread error number. */
+int rtStartThread(pthread_t *thread, void *(*start)(void *), void *arg, int priority, int cpu)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+	int err;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, RT_STACK_SIZE);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	pthread_attr_setschedparam(&attr, &param);
+	if (cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+	err = pthread_create(thread, &attr, start, arg);
+	pthread_attr_destroy(&attr);
+	if (err != 0)
+		logMessage("Real-time: failed to start SCHED_FIFO %d thread on cpu %d (%s)",
+				priority, cpu, strerror(err));
+	return err;
+}
+
+void rtJitterReset(struct rtJitter *jitter)
+{
+	memset(jitter, 0, sizeof(*jitter));
+}
+
+void rtJitterAdd(struct rtJitter *jitter, long long latencyNs, unsigned long missed)
+{
+	if (jitter->samples == 0 || latencyNs < jitter->minNs)
+		jitter->minNs = latencyNs;
+	if (jitter->samples == 0 || latencyNs > jitter->maxNs)
+		jitter->maxNs = latencyNs;
+	jitter->samples++;
+	jitter->overruns += missed;
+	jitter->sumNs += latencyNs;
+	jitter->sumSqNs += (double)latencyNs*(double)latencyNs;
+}
+
+void rtJitterReport(const struct rtJitter *jitter, long long periodNs)
+{
+	if (jitter->samples == 0) {
+		logMessage("Real-time jitter: no samples yet");
+		return;
+	}
+	double mean = jitter->sumNs/jitter->samples;
+	double var = jitter->sumSqNs/jitter->samples - mean*mean;
+	logMessage("Real-time jitter over %lu samples (period %lld us): min %.1f us, mean %.1f us, "
+			"max %.1f us, stddev %.1f us, %lu overruns", jitter->samples, periodNs/1000,
+			jitter->minNs/1000.0, mean/1000.0, jitter->maxNs/1000.0,
+			(var > 0 ? sqrt(var) : 0.0)/1000.0, jitter->overruns);
+}
+
+void timespecAddNs(struct timespec *ts, long long ns)
+{
+	ts->tv_sec += ns/1000000000LL;
+	ts->tv_nsec += ns%1000000000LL;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+long long timespecDiffNs(const struct timespec *a, const struct timespec *b)
+{
+	return (long long)(a->tv_sec - b->tv_sec)*1000000000LL + (a->tv_nsec - b->tv_nsec);
+}
@@ -0,0 +1,45 @@
+//============================================================================
+// Name        	: realtime.h
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.2
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: Real-time acquisition helpers (memory locking, SCHED_FIFO
+//				:  threads, wake-up jitter statistics) header file
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#ifndef REALTIME_H_
+#define REALTIME_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+#define RT_STACK_SIZE		(64*1024)	/* Stack reserved for real-time threads */
+#define RT_STACK_PREFAULT	(32*1024)	/* Portion touched before the first sample */
+
+/* Wake-up latency accumulated by the consumer, in nanoseconds */
+struct rtJitter {
+	unsigned long samples;
+	unsigned long overruns;	/* Wake-ups that missed one or more whole periods */
+	long long minNs;
+	long long maxNs;
+	double sumNs;
+	double sumSqNs;
+};
+
+int rtLockMemory(void);
+void rtPrefaultStack(size_t bytes);
+int rtStartThread(pthread_t *thread, void *(*start)(void *), void *arg, int priority, int cpu);
+
+void rtJitterReset(struct rtJitter *jitter);
+void rtJitterAdd(struct rtJitter *jitter, long long latencyNs, unsigned long missed);
+void rtJitterReport(const struct rtJitter *jitter, long long periodNs);
+
+void timespecAddNs(struct timespec *ts, long long ns);
+long long timespecDiffNs(const struct timespec *a, const struct timespec *b);	/* a - b */
+
+#endif /* REALTIME_H_ */
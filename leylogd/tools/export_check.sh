@@ -0,0 +1,127 @@
+#!/bin/sh
+#============================================================================
+# Name        	: export_check.sh
+# Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+# Project	   	: leylogd
+# Description 	: Exporter spool/replay check against leylogd-collector
+# Notes		: export_check.sh [<dir with leylogd-collector and leylogd-export-feed>]
+#				:  Run by 'make -C Debug export-check'. Uses a unix: endpoint,
+#				:  where a stopped collector is refused immediately (over UDP
+#				:  the datagram in flight when it stops is lost, by design).
+#				:  1) collector stopped and restarted mid run with room in the
+#				:     spool: every reading arrives once, in order
+#				:  2) collector stopped for the rest of the run with a 1 KiB
+#				:     spool: readings are dropped, the survivors stay in order
+#				:     and the spool file never grows past the bound
+#				:  3) feeder killed part way through replaying a full spool
+#				:     and started again: the rest of the spool is replayed,
+#				:     nothing that had been delivered is sent twice except
+#				:     the one datagram a kill between sending it and saving
+#				:     <spool>.pos can leave unrecorded
+#============================================================================
+BIN=${1:-.}
+WORK=$(mktemp -d /tmp/leylogd-export-check.XXXXXX)
+SOCK=$WORK/collector.sock
+FAILED=0
+trap 'kill $COLLECTOR 2>/dev/null; rm -rf "$WORK"' EXIT
+
+startCollector() {
+	"$BIN/leylogd-collector" "unix:$SOCK" >>"$WORK/received" 2>>"$WORK/collector.log" &
+	COLLECTOR=$!
+	while [ ! -S "$SOCK" ]; do sleep 0.05; done
+}
+
+stopCollector() {
+	kill $COLLECTOR
+	wait $COLLECTOR 2>/dev/null
+}
+
+# Stop the collector once nothing new has arrived for 0.3 s (at most 5 s),
+# so a busy machine doesn't cut off datagrams still in flight
+drainCollector() {
+	LAST=-1; TRIES=0
+	while [ $TRIES -lt 25 ]; do
+		N=$(wc -l <"$WORK/received")
+		[ "$N" -eq "$LAST" ] && break
+		LAST=$N; TRIES=$((TRIES + 1))
+		sleep 0.3
+	done
+	stopCollector
+}
+
+# Prints "<readings> <in order: 1|0> <duplicates>" for the seq values
+# received; a repeat of the one just before doesn't count as out of order
+checkOrder() {
+	sed -n 's/.* seq=\([0-9]*\)i .*/\1/p' "$WORK/received" | awk '
+		{ if ($1 < last) bad = 1; if (seen[$1]++) dup++; else n++; last = $1 }
+		END { printf "%d %d %d\n", n, bad ? 0 : 1, dup + 0 }'
+}
+
+fail() {
+	echo "FAIL: $*"
+	FAILED=1
+}
+
+# 1) Outage shorter than the spool
+: >"$WORK/received"
+startCollector
+"$BIN/leylogd-export-feed" -n 1500 -p 4 -b 200 -m 20 -k 64 "unix:$SOCK" "$WORK/spool" \
+	>"$WORK/feed.out" 2>"$WORK/feed.log" &
+FEED=$!
+sleep 1.5; stopCollector
+sleep 2; startCollector
+wait $FEED
+drainCollector
+set -- $(checkOrder)
+SPOOLED=$(sed -n 's/.*max_spool_bytes \([0-9]*\).*/\1/p' "$WORK/feed.out")
+echo "restart: $1 of 1500 readings received, in order=$2, duplicates=$3, spool peaked at $SPOOLED bytes"
+[ "$1" -eq 1500 ] || fail "readings lost across a collector restart"
+[ "$2" -eq 1 ] || fail "replay out of order"
+[ "$3" -eq 0 ] || fail "readings delivered twice"
+[ "$SPOOLED" -gt 0 ] || fail "nothing was spooled while the collector was down"
+
+# 2) Outage longer than a 1 KiB spool holds
+: >"$WORK/received"
+rm -f "$WORK/spool" "$WORK/spool.ckpt" "$WORK/spool.pos"
+startCollector
+"$BIN/leylogd-export-feed" -n 1000 -p 4 -b 200 -m 20 -k 1 "unix:$SOCK" "$WORK/spool" \
+	>"$WORK/feed.out" 2>"$WORK/feed.log" &
+FEED=$!
+sleep 0.5; stopCollector
+sleep 3; startCollector
+wait $FEED
+drainCollector
+set -- $(checkOrder)
+SPOOLED=$(sed -n 's/.*max_spool_bytes \([0-9]*\).*/\1/p' "$WORK/feed.out")
+echo "bounded: $1 of 1000 readings received, in order=$2, spool peaked at $SPOOLED of 1024 bytes"
+grep -q "dropped" "$WORK/feed.log" && grep "batches sent" "$WORK/feed.log" | tail -1
+[ "$1" -lt 1000 ] || fail "nothing was dropped although the spool was full"
+[ "$2" -eq 1 ] || fail "replay out of order"
+[ "$SPOOLED" -le 1024 ] || fail "spool grew past its bound"
+
+# 3) Restart while replaying: spool 3000 one-reading batches with the
+# collector down, start replaying them (about 2 s at EXPORT_REPLAY_BATCHES
+# per EXPORT_REPLAY_MSEC), kill the feeder half a second in and resume
+: >"$WORK/received"
+rm -f "$WORK/spool" "$WORK/spool.ckpt" "$WORK/spool.pos" "$SOCK"
+"$BIN/leylogd-export-feed" -n 3000 -p 1 -b 60 -k 1024 -d 0 "unix:$SOCK" "$WORK/spool" \
+	>"$WORK/feed.out" 2>"$WORK/feed.log"
+startCollector
+"$BIN/leylogd-export-feed" -n 0 "unix:$SOCK" "$WORK/spool" >"$WORK/feed.out" 2>"$WORK/feed.log" &
+FEED=$!
+sleep 0.5; kill -9 $FEED
+wait $FEED 2>/dev/null
+set -- $(checkOrder)
+FIRST=$1
+"$BIN/leylogd-export-feed" -n 0 "unix:$SOCK" "$WORK/spool" >"$WORK/feed.out" 2>"$WORK/feed.log"
+drainCollector
+set -- $(checkOrder)
+echo "replay restart: $FIRST then $1 of 3000 readings received, in order=$2, duplicates=$3"
+grep "Resuming replay" "$WORK/feed.log"
+[ "$FIRST" -gt 0 ] && [ "$FIRST" -lt 3000 ] || fail "the feeder wasn't killed part way through the replay"
+[ "$1" -eq 3000 ] || fail "readings lost across a restart during replay"
+[ "$2" -eq 1 ] || fail "replay out of order"
+[ "$3" -le 1 ] || fail "delivered readings replayed again after the restart"
+
+[ $FAILED -eq 0 ] && echo "export check passed"
+exit $FAILED
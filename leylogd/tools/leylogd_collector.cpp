@@ -0,0 +1,160 @@
+//============================================================================
+// Name        	: leylogd_collector.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.3
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: leylogd-collector, local stand-in for a metrics collector
+// Notes		: leylogd-collector [-n <datagrams>] <unix:<path>|udp:<host>:<port>>
+//				:  Binds the endpoint leylogd exports to and prints every
+//				:  line of every datagram on stdout as it arrives. Stops on
+//				:  SIGINT/SIGTERM (or after -n datagrams), removing a unix
+//				:  socket so it can simply be started again; stopping it is
+//				:  how the exporter's spool and replay are exercised.
+//				:  Built on the host: make -C Debug leylogd-collector
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define COLLECTOR_DATAGRAM	65536
+
+static volatile sig_atomic_t stopReceived = 0;
+
+static void stopHandler(int)
+{
+	stopReceived = 1;
+}
+
+/* Same endpoint syntax as the exporter */
+static int bindEndpoint(const char *endpoint, char *unixPath, size_t pathLen)
+{
+	int sock;
+
+	unixPath[0] = '\0';
+	if (strncmp(endpoint, "unix:", 5) == 0) {
+		struct sockaddr_un un;
+		memset(&un, 0, sizeof(un));
+		un.sun_family = AF_UNIX;
+		if (strlen(endpoint + 5) == 0 || strlen(endpoint + 5) >= sizeof(un.sun_path)
+				|| strlen(endpoint + 5) >= pathLen)
+			return -1;
+		strcpy(un.sun_path, endpoint + 5);
+		if ((sock = socket(AF_UNIX, SOCK_DGRAM, 0)) == -1)
+			return -1;
+		unlink(un.sun_path);	/* Left behind by a collector that was killed */
+		if (bind(sock, (struct sockaddr *)&un, sizeof(un)) == -1) {
+			close(sock);
+			return -1;
+		}
+		strcpy(unixPath, un.sun_path);
+		return sock;
+	}
+	if (strncmp(endpoint, "udp:", 4) != 0)
+		return -1;
+
+	char node[256];
+	strncpy(node, endpoint + 4, sizeof(node) - 1);
+	node[sizeof(node) - 1] = '\0';
+	char *port = strrchr(node, ':');
+	if (port == NULL)
+		return -1;
+	*port++ = '\0';
+	char *host = node;
+	size_t len = strlen(host);
+	if (len >= 2 && host[0] == '[' && host[len - 1] == ']') {
+		host[len - 1] = '\0';
+		host++;
+	}
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+	int err = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", endpoint, gai_strerror(err));
+		return -1;
+	}
+	sock = socket(res->ai_family, SOCK_DGRAM, 0);
+	int on = 1;
+	if (sock != -1)
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (sock != -1 && bind(sock, res->ai_addr, res->ai_addrlen) == -1) {
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(res);
+	return sock;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-n <datagrams>] <unix:<path>|udp:<host>:<port>>\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	long limit = -1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n': limit = atol(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1)
+		usage(argv[0]);
+
+	struct sigaction act;	/* No SA_RESTART, so recv() returns on a signal */
+	memset(&act, 0, sizeof(act));
+	sigemptyset(&act.sa_mask);
+	act.sa_handler = stopHandler;
+	sigaction(SIGINT, &act, NULL);
+	sigaction(SIGTERM, &act, NULL);
+
+	char unixPath[108];
+	int sock = bindEndpoint(argv[optind], unixPath, sizeof(unixPath));
+	if (sock == -1) {
+		fprintf(stderr, "%s: cannot bind (%s)\n", argv[optind], strerror(errno));
+		return EXIT_FAILURE;
+	}
+	fprintf(stderr, "Collecting on %s\n", argv[optind]);
+
+	static char datagram[COLLECTOR_DATAGRAM + 1];
+	long datagrams = 0, lines = 0;
+	while (!stopReceived && (limit < 0 || datagrams < limit)) {
+		ssize_t n = recv(sock, datagram, COLLECTOR_DATAGRAM, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "recv: %s\n", strerror(errno));
+			break;
+		}
+		datagram[n] = '\0';
+		datagrams++;
+		for (char *c = datagram; *c; c++)
+			lines += (*c == '\n');
+		fputs(datagram, stdout);
+		if (n > 0 && datagram[n - 1] != '\n')
+			fputc('\n', stdout);
+		fflush(stdout);
+	}
+	close(sock);
+	if (unixPath[0] != '\0')
+		unlink(unixPath);
+	fprintf(stderr, "%ld datagrams, %ld lines\n", datagrams, lines);
+	return EXIT_SUCCESS;
+}
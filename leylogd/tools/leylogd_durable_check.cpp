@@ -0,0 +1,228 @@
+//============================================================================
+// Name        	: leylogd_durable_check.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.0
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: leylogd-durable-check, DataWriter recovery checks off-target
+// Notes		: leylogd-durable-check [<work dir>]
+//				:  Writes record files with DataWriter, damages them the way
+//				:  a power cut or a bad sector would and opens them again:
+//				:  1) corrupt record mid-file, no checkpoint: skipped, every
+//				:     record after it kept
+//				:  2) corrupt record past the checkpoint: cut off there
+//				:  3) torn tail, no checkpoint: truncated
+//				:  4) appends stop: sync_msec still syncs them
+//				:  Run by 'make -C Debug durable-check'.
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "DataWriter.h"
+
+#define CHECK_RECORDS	5000	/* 200 KB, several scan buffers */
+#define RECORD_SIZE		(sizeof(DataRecordHeader) + 24)	/* Every payload is 24 bytes */
+
+static int skippedMessages = 0;
+static int failed = 0;
+
+/* DataWriter reports through logMessage(); count the resyncs */
+void logMessage(const char *format,...)
+{
+	char line[512];
+	va_list argList;
+	va_start(argList, format);
+	vsnprintf(line, sizeof(line), format, argList);
+	va_end(argList);
+	if (strstr(line, "Skipping") != NULL)
+		skippedMessages++;
+	fprintf(stderr, "  %s\n", line);
+}
+
+static void check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+	if (!ok)
+		failed = 1;
+}
+
+/* Records first..first+count-1, each "record <n>" padded to 24 bytes */
+static void writeRecords(DataWriter *dw, int first, int count)
+{
+	for (int i = first; i < first + count; i++){
+		char payload[24];
+		memset(payload, ' ', sizeof(payload));
+		memcpy(payload, "record", 6);
+		snprintf(payload + 7, sizeof(payload) - 7, "%d", i);
+		dw->append(CSV_Record, payload, sizeof(payload));
+	}
+}
+
+/* Number of the first and last valid records and how many there are,
+ * skipping corrupt stretches the way a reader would */
+static int countRecords(const char *path, int *first, int *last)
+{
+	int fd = open(path, O_RDONLY), n = 0;
+	char payload[DW_MAX_PAYLOAD + 1];
+	DataRecordHeader hdr;
+	off_t offset = 0;
+	int r;
+
+	*first = *last = -1;
+	while (fd >= 0 && (r = DataWriter::readRecord(fd, offset, &hdr, payload, DW_MAX_PAYLOAD)) != 0){
+		if (r < 0){
+			if ((offset = DataWriter::nextRecord(fd, offset + 1)) < 0)
+				break;
+			continue;
+		}
+		payload[hdr.length] = '\0';
+		*last = atoi(payload + 7);
+		if (n++ == 0)
+			*first = *last;
+		offset += sizeof(hdr) + hdr.length;
+	}
+	if (fd >= 0)
+		close(fd);
+	return n;
+}
+
+static void corrupt(const char *path, off_t offset)
+{
+	int fd = open(path, O_WRONLY);
+	char bad = 0x5a;
+	if (fd < 0 || pwrite(fd, &bad, 1, offset) != 1)
+		perror(path);
+	if (fd >= 0)
+		close(fd);
+}
+
+static off_t fileSize(const char *path)
+{
+	struct stat sb;
+	return (stat(path, &sb) == 0) ? sb.st_size : -1;
+}
+
+static void removeFiles(const char *path)
+{
+	char ckpt[4200];
+	snprintf(ckpt, sizeof(ckpt), "%s.ckpt", path);
+	unlink(path);
+	unlink(ckpt);
+}
+
+int main(int argc, char *argv[])
+{
+	char dir[] = "/tmp/leylogd-durable-check.XXXXXX";
+	const char *work = (argc > 1) ? argv[1] : mkdtemp(dir);
+	char path[4096], ckpt[4200];
+	int first, last, n;
+
+	if (work == NULL){
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	snprintf(path, sizeof(path), "%s/check.dat", work);
+	snprintf(ckpt, sizeof(ckpt), "%s.ckpt", path);
+
+	/* 1) A corrupt record mid-file without a checkpoint */
+	removeFiles(path);
+	{
+		DataWriter dw;
+		dw.open(path, 64, 0, 0);
+		writeRecords(&dw, 0, CHECK_RECORDS);
+	}
+	off_t size = fileSize(path);
+	corrupt(path, (CHECK_RECORDS/2)*RECORD_SIZE + sizeof(DataRecordHeader) + 3);
+	unlink(ckpt);
+	skippedMessages = 0;
+	{
+		DataWriter dw;
+		dw.open(path, 64, 0, 0);
+	}
+	n = countRecords(path, &first, &last);
+	printf("mid-file: %d records (%d..%d), %ld of %ld bytes kept\n", n, first, last,
+			(long)fileSize(path), (long)size);
+	check(n == CHECK_RECORDS - 1 && last == CHECK_RECORDS - 1 && fileSize(path) == size,
+			"a corrupt record mid-file costs only that record");
+	check(skippedMessages == 1, "the corrupt record is logged");
+
+	/* 2) A corrupt record after the checkpoint: the writer dies without
+	 * closing, so the records past the last sync were never synced */
+	removeFiles(path);
+	pid_t child = fork();
+	if (child == 0){
+		DataWriter *dw = new DataWriter();
+		dw->open(path, CHECK_RECORDS, 0, 0);
+		writeRecords(dw, 0, CHECK_RECORDS/2);
+		dw->sync();
+		writeRecords(dw, CHECK_RECORDS/2, CHECK_RECORDS/2);
+		_exit(0);
+	}
+	waitpid(child, NULL, 0);
+	corrupt(path, (CHECK_RECORDS*3/4)*RECORD_SIZE + sizeof(DataRecordHeader) + 3);
+	{
+		DataWriter dw;
+		dw.open(path, 64, 0, 0);
+	}
+	n = countRecords(path, &first, &last);
+	printf("past checkpoint: %d records (%d..%d)\n", n, first, last);
+	check(n == CHECK_RECORDS*3/4 && last == CHECK_RECORDS*3/4 - 1,
+			"unsynced records are cut at the first corrupt one");
+
+	/* 3) A torn tail without a checkpoint */
+	removeFiles(path);
+	{
+		DataWriter dw;
+		dw.open(path, 64, 0, 0);
+		writeRecords(&dw, 0, 10);
+	}
+	size = fileSize(path);
+	int fd = open(path, O_WRONLY | O_APPEND);
+	if (fd < 0 || write(fd, "LYLDtorn", 8) != 8)
+		perror(path);
+	if (fd >= 0)
+		close(fd);
+	unlink(ckpt);
+	{
+		DataWriter dw;
+		dw.open(path, 64, 0, 0);
+	}
+	n = countRecords(path, &first, &last);
+	check(n == 10 && fileSize(path) == size, "a torn tail is truncated");
+
+	/* 4) The sync_msec bound without further appends */
+	removeFiles(path);
+	{
+		DataWriter dw;
+		dw.open(path, CHECK_RECORDS, 100, 0);
+		writeRecords(&dw, 0, 1);
+		long due = dw.msecUntilSync();
+		check(due > 0 && due <= 100, "a pending record has a sync deadline");
+		usleep(150*1000);
+		check(dw.msecUntilSync() == 0, "the deadline passes without an append");
+		dw.syncIfDue();
+		struct DataCheckpoint cp;
+		int cfd = open(ckpt, O_RDONLY);
+		int synced = (cfd >= 0 && pread(cfd, &cp, sizeof(cp), 0) == (ssize_t)sizeof(cp)
+				&& (off_t)cp.offset == dw.size());
+		if (cfd >= 0)
+			close(cfd);
+		check(synced && dw.msecUntilSync() == -1, "syncIfDue() then syncs it");
+	}
+
+	removeFiles(path);
+	if (argc <= 1)
+		rmdir(work);
+	if (failed == 0)
+		printf("durable check passed\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
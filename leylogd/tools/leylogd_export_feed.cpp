@@ -0,0 +1,118 @@
+//============================================================================
+// Name        	: leylogd_export_feed.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.4
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: leylogd-export-feed, drives the daemon's Exporter off-target
+// Notes		: leylogd-export-feed [-n <readings>] [-p <period ms>]
+//				:  [-b <batch bytes>] [-m <export ms>] [-k <spool KiB>]
+//				:  [-d <drain ms>] <endpoint> <spool file>
+//				:  Adds readings "seq=<n>i" through Exporter exactly as
+//				:  leylogd does, waiting in ppoll() on msecUntilDue() between
+//				:  them, then keeps flushing until the spool has drained (or
+//				:  -d ms pass, 10 s by default; -n 0 only drains what an
+//				:  earlier run left spooled). Prints the largest spool file size seen so
+//				:  tools/export_check.sh can hold it against the bound.
+//				:  Built on the host: make -C Debug leylogd-export-feed
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "Exporter.h"
+
+#define DRAIN_MSEC	10000
+
+void logMessage(const char *format,...)
+{
+	va_list argList;
+	va_start(argList, format);
+	vfprintf(stderr, format, argList);
+	fprintf(stderr, "\n");
+	va_end(argList);
+}
+
+static long long nowMsec(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000LL + now.tv_nsec/1000000;
+}
+
+/* Sleep until 'until' while letting the exporter flush and replay */
+static void serviceUntil(Exporter *exporter, long long until, const char *spool, off_t *maxSpool)
+{
+	struct stat sb;
+	long long left;
+
+	while ((left = until - nowMsec()) > 0) {
+		long due = exporter->msecUntilDue();
+		long wait = (due >= 0 && due < left) ? due : (long)left;
+		struct timespec ts = {wait/1000, (wait%1000)*1000000L};
+		if (ppoll(NULL, 0, &ts, NULL) == 0 && due >= 0 && due <= wait)
+			exporter->flushIfDue();
+		if (stat(spool, &sb) == 0 && sb.st_size > *maxSpool)
+			*maxSpool = sb.st_size;
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-n <readings>] [-p <period ms>] [-b <batch bytes>]"
+			" [-m <export ms>] [-k <spool KiB>] [-d <drain ms>] <endpoint> <spool file>\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	long readings = 1000, periodMsec = 5;
+	long drainMsec = DRAIN_MSEC;
+	int batchBytes = 200, exportMsec = 20, spoolKb = 64;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:p:b:m:k:d:h")) != -1) {
+		switch (opt) {
+		case 'n': readings = atol(optarg); break;
+		case 'p': periodMsec = atol(optarg); break;
+		case 'b': batchBytes = atoi(optarg); break;
+		case 'm': exportMsec = atoi(optarg); break;
+		case 'k': spoolKb = atoi(optarg); break;
+		case 'd': drainMsec = atol(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2)
+		usage(argv[0]);
+	const char *spool = argv[optind + 1];
+
+	Exporter exporter;
+	if (exporter.open(argv[optind], spool, batchBytes, exportMsec, spoolKb) == -1)
+		return EXIT_FAILURE;
+
+	off_t maxSpool = 0;
+	long long next = nowMsec();
+	for (long seq = 1; seq <= readings; seq++) {
+		char fields[32];
+		snprintf(fields, sizeof(fields), "seq=%ldi", seq);
+		exporter.add(NULL, fields);
+		next += periodMsec;
+		serviceUntil(&exporter, next, spool, &maxSpool);
+	}
+	/* Drain: keep servicing until nothing is queued or the deadline passes */
+	long long deadline = nowMsec() + drainMsec;
+	exporter.flush();
+	while (exporter.msecUntilDue() >= 0 && nowMsec() < deadline)
+		serviceUntil(&exporter, nowMsec() + 100, spool, &maxSpool);
+	exporter.close();
+	printf("readings %ld max_spool_bytes %ld spool_bound_bytes %ld\n",
+			readings, (long)maxSpool, spoolKb*1024L);
+	return EXIT_SUCCESS;
+}
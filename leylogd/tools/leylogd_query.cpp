@@ -0,0 +1,222 @@
+//============================================================================
+// Name        	: leylogd_query.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.5
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: leylogd-query, time range extraction using the time index
+// Notes		: leylogd-query [-i <index>] <data file> <from> <to>
+//				:  <data file> is leyld.csv or the durable leyld.dat; the
+//				:  index defaults to <data file>.idx. <from>/<to> are epoch
+//				:  seconds, "YYYY-MM-DD HH:MM:SS" local time or "-" for an
+//				:  open end. Only the stretches of the data file between index
+//				:  entries that can overlap the range are read. Rows are
+//				:  printed as csv with the elapsed time column replaced by
+//				:  "Epoch"; the bytes read are reported on stderr.
+//				:  Built on the host: make -C Debug leylogd-query
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "DataWriter.h"
+#include "TimeIndex.h"
+
+#define TIME_MIN	(-0x7fffffffffffffffLL - 1)
+#define TIME_MAX	0x7fffffffffffffffLL
+
+struct dataSource {
+	int fd;
+	FILE *fp;			/* Plain csv, NULL for durable records */
+	off_t size;
+	off_t bytesRead;
+};
+
+/* DataWriter reports through logMessage(), keep it on stderr */
+void logMessage(const char *format,...)
+{
+	va_list argList;
+	va_start(argList, format);
+	vfprintf(stderr, format, argList);
+	fprintf(stderr, "\n");
+	va_end(argList);
+}
+
+/* Epoch seconds (fractions allowed), local "YYYY-MM-DD[ T]HH:MM:SS" or "-" */
+static int parseTime(const char *arg, int64_t openEnd, int64_t *usec)
+{
+	struct tm tm;
+	const char *end;
+	char *dend;
+
+	if (strcmp(arg, "-") == 0) {
+		*usec = openEnd;
+		return 0;
+	}
+	memset(&tm, 0, sizeof(tm));
+	if (((end = strptime(arg, "%Y-%m-%d %H:%M:%S", &tm)) != NULL
+			|| (end = strptime(arg, "%Y-%m-%dT%H:%M:%S", &tm)) != NULL) && *end == '\0') {
+		tm.tm_isdst = -1;
+		*usec = (int64_t)mktime(&tm)*1000000;
+		return 0;
+	}
+	double sec = strtod(arg, &dend);
+	if (dend == arg || *dend != '\0')
+		return -1;
+	*usec = (int64_t)(sec*1000000.0);
+	return 0;
+}
+
+/* Read the row at offset into row (NUL terminated, no newline); returns its
+ * length and sets *next, or -1 at the end of the data or a corrupt record */
+static long readRow(struct dataSource *src, off_t offset, char *row, size_t max, off_t *next)
+{
+	if (offset >= src->size)
+		return -1;
+	if (src->fp == NULL) {
+		DataRecordHeader hdr;
+		if (DataWriter::readRecord(src->fd, offset, &hdr, row, max - 1) != 1)
+			return -1;
+		row[hdr.length] = '\0';
+		*next = offset + sizeof(DataRecordHeader) + hdr.length;
+		src->bytesRead += *next - offset;
+		return hdr.length;
+	}
+	if (ftello(src->fp) != offset && fseeko(src->fp, offset, SEEK_SET) == -1)
+		return -1;
+	if (fgets(row, max, src->fp) == NULL)
+		return -1;
+	size_t len = strlen(row);
+	*next = offset + len;
+	src->bytesRead += len;
+	if (len > 0 && row[len - 1] == '\n')
+		row[--len] = '\0';
+	return len;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-i <index>] <data file> <from> <to>\n"
+			"  <from>/<to>: epoch seconds, \"YYYY-MM-DD HH:MM:SS\" or -\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *indexFile = NULL;
+	char defaultIndex[4096];
+	int64_t from, to;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:h")) != -1) {
+		switch (opt) {
+		case 'i': indexFile = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (argc - optind != 3)
+		usage(argv[0]);
+	const char *dataFile = argv[optind];
+	if (parseTime(argv[optind + 1], TIME_MIN, &from) == -1
+			|| parseTime(argv[optind + 2], TIME_MAX, &to) == -1)
+		usage(argv[0]);
+	if (indexFile == NULL) {
+		snprintf(defaultIndex, sizeof(defaultIndex), "%s.idx", dataFile);
+		indexFile = defaultIndex;
+	}
+
+	TimeIndexEntry *entries;
+	long n = TimeIndex::load(indexFile, &entries);
+	if (n == -1) {
+		fprintf(stderr, "%s: %s\n", indexFile, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	struct dataSource src;
+	struct stat sb;
+	uint32_t magic = 0;
+	memset(&src, 0, sizeof(src));
+	if ((src.fd = open(dataFile, O_RDONLY)) == -1 || fstat(src.fd, &sb) == -1) {
+		fprintf(stderr, "%s: %s\n", dataFile, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	src.size = sb.st_size;
+	if (pread(src.fd, &magic, sizeof(magic), 0) != (ssize_t)sizeof(magic) || magic != DW_RECORD_MAGIC) {
+		if ((src.fp = fdopen(src.fd, "r")) == NULL) {
+			fprintf(stderr, "%s: %s\n", dataFile, strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	char row[DW_MAX_PAYLOAD + 1];
+	char header[DW_MAX_PAYLOAD + 1] = "";	/* Column names, from the header row */
+	int64_t base = 0;			/* Time of the current segment's header row */
+	off_t baseOffset = -1;
+	unsigned long rows = 0;
+	long blocks = 0;
+	for (long i = 0; i < n; i++) {
+		if (entries[i].flags & TI_SEGMENT_START) {
+			base = entries[i].usec;
+			baseOffset = entries[i].offset;
+		}
+		if (baseOffset < 0)
+			continue;	/* Nothing to measure elapsed times from */
+		/* Rows from this entry up to the next lie within [usec, next usec],
+		 * unless the next entry starts a new run */
+		off_t offset = entries[i].offset;
+		off_t end = (i + 1 < n) ? (off_t)entries[i + 1].offset : src.size;
+		int64_t last = (i + 1 < n && !(entries[i + 1].flags & TI_SEGMENT_START))
+				? entries[i + 1].usec : TIME_MAX;
+		if (last < from || entries[i].usec > to)
+			continue;
+		blocks++;
+		while (offset < end) {
+			off_t next;
+			if (readRow(&src, offset, row, sizeof(row), &next) < 0)
+				break;
+			char *rest;
+			double elapsed = strtod(row, &rest);
+			if (offset == baseOffset || rest == row || *rest != ',') {
+				offset = next;	/* The segment's header row */
+				continue;
+			}
+			/* Rounded, the "%.6f" elapsed time is exact to the microsecond */
+			int64_t t = base + (int64_t)(elapsed*1000000.0 + (elapsed < 0 ? -0.5 : 0.5));
+			if (t > to)
+				break;
+			if (t >= from) {
+				if (rows++ == 0) {
+					/* Column names only; not part of the range's cost */
+					off_t skip, counted = src.bytesRead;
+					readRow(&src, baseOffset, header, sizeof(header), &skip);
+					src.bytesRead = counted;
+					const char *columns = strchr(header, ',');
+					printf("Epoch%s\n", columns ? columns : "");
+				}
+				/* Sign apart, or -0.5 s would print as "0.-500000" */
+				int64_t mag = (t < 0) ? -t : t;
+				printf("%s%lld.%06lld%s\n", (t < 0) ? "-" : "", (long long)(mag/1000000),
+						(long long)(mag%1000000), rest);
+			}
+			offset = next;
+		}
+	}
+	fprintf(stderr, "%lu rows; read %ld of %ld bytes in %ld stretches (%ld index entries)\n",
+			rows, (long)src.bytesRead, (long)src.size, blocks, n);
+	if (src.fp != NULL)
+		fclose(src.fp);
+	else
+		close(src.fd);
+	free(entries);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,384 @@
+//============================================================================
+// Name        	: leylogd_replay.cpp
+// Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+// Version     	: 1.4.4
+// Project	   	: leylogd
+// Created     	: 19/10/26
+// Modified    	: 19/10/26
+// Copyright   	: Do not modify or distribute without express written permission
+//				: of the author
+// Description 	: leylogd-replay, offline reprocessing of raw frame logs
+// Notes		: leylogd-replay [-j <threads>] [-o <dir>] <leyld.raw>...
+//				:  Converts every Raw_Frame record with the TMP102 and
+//				:  MPL3115A2 conversion code the daemon is built with and
+//				:  writes <name>.csv (next to the input, or in <dir>). Inputs
+//				:  are cut into REPLAY_CHUNK pieces, each starting at the
+//				:  first valid record (magic and crc) past its nominal offset,
+//				:  and handed out largest file first to one worker per core;
+//				:  the pieces' csv parts are joined in order afterwards, so a
+//				:  unit's single multi-year leyld.raw still uses every core.
+//				:  Corrupt stretches are skipped up to the next valid record.
+//				:  Rows are "Epoch,Temperature_TMP102,Pressure_MPL,
+//				:  Temperature_MPL"; a sensor that failed to read leaves its
+//				:  fields empty.
+//				:  Built on the host: make -C Debug leylogd-replay
+// GitHub		: https://github.com/ChristopherLey/leylogd.git
+//===========================================================================
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "DataWriter.h"
+#include "raw_frame.h"
+
+#define OUTPUT_BUFFER (1 << 20)	/* stdio buffer per output file */
+#define REPLAY_CHUNK (8 << 20)	/* Input bytes per unit of work */
+
+struct replayJob {
+	const char *input;
+	char output[4096];
+	off_t size;
+	int fd;
+	const char *map;			/* Whole input, shared by its chunks */
+	int chunks;
+	unsigned long records;
+	unsigned long skipped;		/* Valid records of other types */
+	off_t tornAt;				/* First corrupt offset, -1 if none */
+	off_t corruptBytes;
+	int failed;
+};
+
+struct replayChunk {
+	struct replayJob *job;
+	int index;
+	char output[4096 + 16];		/* The job's output, or a .part<n> of it */
+	unsigned long records;
+	unsigned long skipped;
+	off_t tornAt;
+	off_t corruptBytes;
+	int failed;
+};
+
+static struct replayJob *jobs;
+static int jobCount;
+static struct replayChunk *chunks;
+static int chunkCount;
+static volatile int nextChunk = 0;
+
+/* The driver sources report through logMessage(); they are never asked to
+ * touch a bus here, but keep their messages on stderr. */
+void logMessage(const char *format,...)
+{
+	va_list argList;
+	va_start(argList, format);
+	vfprintf(stderr, format, argList);
+	fprintf(stderr, "\n");
+	va_end(argList);
+}
+
+/* Returns -1 if the output path doesn't fit job->output */
+static int outputName(struct replayJob *job, const char *outDir)
+{
+	const char *base = strrchr(job->input, '/');
+	char stem[4096];
+
+	base = (base != NULL && outDir != NULL) ? base + 1 : job->input;
+	strncpy(stem, base, sizeof(stem) - 1);
+	stem[sizeof(stem) - 1] = '\0';
+	char *ext = strrchr(stem, '.');
+	if (ext != NULL && strcmp(ext, ".raw") == 0)
+		*ext = '\0';
+	int len;
+	if (outDir != NULL)
+		len = snprintf(job->output, sizeof(job->output), "%s/%s.csv", outDir, stem);
+	else
+		len = snprintf(job->output, sizeof(job->output), "%s.csv", stem);
+	if (len < 0 || len >= (int)sizeof(job->output)) {
+		fprintf(stderr, "%s: output path too long\n", job->input);
+		return -1;
+	}
+	return 0;
+}
+
+static void writeReading(FILE *out, const struct RawReading *raw)
+{
+	fprintf(out, "%u.%06u,", raw->sec, raw->usec);
+	if (raw->valid & RAW_TMP102)
+		fprintf(out, "%f", TMP102::convertTemperature(raw->tmp102[0], raw->tmp102[1]));
+	if (raw->valid & RAW_MPL3115A2) {
+		float pressure, temp;
+		MPL3115A2_Altimeter::convertData(raw->mpl3115a2, (STATE)raw->mplState, &pressure, &temp);
+		fprintf(out, ",%f,%f\n", pressure, temp);
+	} else {
+		fprintf(out, ",,\n");
+	}
+}
+
+/* First offset at or after pos holding a valid record, size if none. The
+ * crc makes a false match inside a payload practically impossible. */
+static off_t resync(const char *map, off_t size, off_t pos)
+{
+	const uint32_t magic = DW_RECORD_MAGIC;
+	DataRecordHeader hdr;
+
+	for (; pos + (off_t)sizeof(DataRecordHeader) <= size; pos++) {
+		if (memcmp(map + pos, &magic, sizeof(magic)) == 0
+				&& DataWriter::parseRecord(map + pos, size - pos, &hdr) > 0)
+			return pos;
+	}
+	return size;
+}
+
+static void replayChunk(struct replayChunk *chunk)
+{
+	struct replayJob *job = chunk->job;
+	const char *map = job->map;
+	off_t size = job->size;
+
+	FILE *out = fopen(chunk->output, "w");
+	if (out == NULL) {
+		fprintf(stderr, "%s: %s\n", chunk->output, strerror(errno));
+		chunk->failed = 1;
+		return;
+	}
+	setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER);
+	if (chunk->index == 0)
+		fprintf(out, "Epoch,Temperature_TMP102,Pressure_MPL,Temperature_MPL\n");
+
+	/* Neighbouring chunks resync from the same nominal offset, so every
+	 * record belongs to exactly one of them */
+	off_t offset = (chunk->index == 0) ? 0 : resync(map, size, (off_t)chunk->index*REPLAY_CHUNK);
+	off_t end = (chunk->index + 1 < job->chunks)
+			? resync(map, size, (off_t)(chunk->index + 1)*REPLAY_CHUNK) : size;
+	DataRecordHeader hdr;
+	while (offset < end) {
+		long len = DataWriter::parseRecord(map + offset, size - offset, &hdr);
+		if (len <= 0) {
+			off_t next = resync(map, size, offset + 1);
+			if (next > end)
+				next = end;
+			if (chunk->tornAt < 0)
+				chunk->tornAt = offset;
+			chunk->corruptBytes += next - offset;
+			offset = next;
+			continue;
+		}
+		if (hdr.type == Raw_Frame && hdr.length == sizeof(struct RawReading)) {
+			struct RawReading raw;
+			memcpy(&raw, map + offset + sizeof(DataRecordHeader), sizeof(raw));
+			writeReading(out, &raw);
+			chunk->records++;
+		} else {
+			chunk->skipped++;
+		}
+		offset += len;
+	}
+	if (fclose(out) != 0) {
+		fprintf(stderr, "%s: %s\n", chunk->output, strerror(errno));
+		chunk->failed = 1;
+	}
+}
+
+static void *replayWorker(void *)
+{
+	int i;
+	while ((i = __sync_fetch_and_add(&nextChunk, 1)) < chunkCount)
+		replayChunk(&chunks[i]);
+	return NULL;
+}
+
+static int mapInput(struct replayJob *job)
+{
+	job->fd = open(job->input, O_RDONLY);
+	if (job->fd == -1) {
+		fprintf(stderr, "%s: %s\n", job->input, strerror(errno));
+		return -1;
+	}
+	if (job->size == 0)
+		return 0;
+	job->map = (const char *)mmap(NULL, job->size, PROT_READ, MAP_PRIVATE, job->fd, 0);
+	if (job->map == MAP_FAILED) {
+		fprintf(stderr, "%s: mmap failed (%s)\n", job->input, strerror(errno));
+		job->map = NULL;
+		return -1;
+	}
+	madvise((void *)job->map, job->size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+/* Append the file at path to fd and remove it */
+static int appendPart(int fd, const char *path)
+{
+	static char buf[OUTPUT_BUFFER];
+	int in = open(path, O_RDONLY);
+	ssize_t n;
+
+	if (in == -1)
+		return -1;
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		if (write(fd, buf, n) != n) {
+			n = -1;
+			break;
+		}
+	}
+	close(in);
+	unlink(path);
+	return (n == 0) ? 0 : -1;
+}
+
+/* Gather the chunks' results and join their parts into the job's output */
+static void finishJob(struct replayJob *job, struct replayChunk *first)
+{
+	int i;
+
+	for (i = 0; i < job->chunks; i++) {
+		struct replayChunk *chunk = &first[i];
+		job->records += chunk->records;
+		job->skipped += chunk->skipped;
+		job->corruptBytes += chunk->corruptBytes;
+		if (job->tornAt < 0)
+			job->tornAt = chunk->tornAt;
+		job->failed |= chunk->failed;
+	}
+	if (job->chunks > 1) {
+		int fd = -1;
+		if (!job->failed && rename(first[0].output, job->output) == 0)
+			fd = open(job->output, O_WRONLY | O_APPEND);
+		for (i = job->failed ? 0 : 1; i < job->chunks; i++) {
+			if (fd == -1 || appendPart(fd, first[i].output) == -1) {
+				unlink(first[i].output);
+				job->failed = 1;
+			}
+		}
+		if (fd == -1 || close(fd) != 0)
+			job->failed = 1;
+		if (job->failed)
+			fprintf(stderr, "%s: failed to assemble %s\n", job->input, job->output);
+	}
+	if (job->map != NULL)
+		munmap((void *)job->map, job->size);
+	if (job->fd >= 0)
+		close(job->fd);
+}
+
+static int bySizeDescending(const void *a, const void *b)
+{
+	off_t sa = ((const struct replayJob *)a)->size, sb = ((const struct replayJob *)b)->size;
+	return (sa < sb) - (sa > sb);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-j <threads>] [-o <dir>] <leyld.raw>...\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *outDir = NULL;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt, i, c;
+
+	while ((opt = getopt(argc, argv, "j:o:h")) != -1) {
+		switch (opt) {
+		case 'j': threads = atol(optarg); break;
+		case 'o': outDir = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0]);
+	if (threads < 1)
+		threads = 1;
+
+	jobCount = argc - optind;
+	jobs = (struct replayJob *)calloc(jobCount, sizeof(struct replayJob));
+	if (jobs == NULL)
+		return EXIT_FAILURE;
+	for (i = 0; i < jobCount; i++) {
+		struct stat sb;
+		jobs[i].input = argv[optind + i];
+		jobs[i].fd = -1;
+		jobs[i].tornAt = -1;
+		jobs[i].size = (stat(jobs[i].input, &sb) == 0) ? sb.st_size : 0;
+		if (outputName(&jobs[i], outDir) == -1 || mapInput(&jobs[i]) == -1)
+			jobs[i].failed = 1;
+		jobs[i].chunks = jobs[i].failed ? 0 : (int)((jobs[i].size + REPLAY_CHUNK - 1)/REPLAY_CHUNK);
+		if (!jobs[i].failed && jobs[i].chunks == 0)
+			jobs[i].chunks = 1;		/* Empty input, still write the header */
+		chunkCount += jobs[i].chunks;
+	}
+	qsort(jobs, jobCount, sizeof(struct replayJob), bySizeDescending);
+
+	/* Largest file's chunks first, so the long tail is small pieces */
+	chunks = (struct replayChunk *)calloc(chunkCount ? chunkCount : 1, sizeof(struct replayChunk));
+	if (chunks == NULL)
+		return EXIT_FAILURE;
+	for (i = 0, c = 0; i < jobCount; i++) {
+		for (int k = 0; k < jobs[i].chunks; k++, c++) {
+			chunks[c].job = &jobs[i];
+			chunks[c].index = k;
+			chunks[c].tornAt = -1;
+			if (jobs[i].chunks == 1)
+				strcpy(chunks[c].output, jobs[i].output);
+			else
+				snprintf(chunks[c].output, sizeof(chunks[c].output), "%s.part%d", jobs[i].output, k);
+		}
+	}
+	if (threads > chunkCount)
+		threads = chunkCount ? chunkCount : 1;
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	pthread_t *workers = (pthread_t *)calloc(threads, sizeof(pthread_t));
+	long started = 0;
+	for (i = 0; i < threads && workers != NULL; i++)
+		if (pthread_create(&workers[i], NULL, replayWorker, NULL) == 0)
+			started++;
+	if (started == 0)
+		replayWorker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	for (i = 0, c = 0; i < jobCount; c += jobs[i].chunks, i++)
+		finishJob(&jobs[i], &chunks[c]);
+	gettimeofday(&end, NULL);
+
+	unsigned long records = 0;
+	off_t bytes = 0;
+	int failed = 0;
+	for (i = 0; i < jobCount; i++) {
+		struct replayJob *job = &jobs[i];
+		if (job->failed) {
+			failed++;
+			continue;
+		}
+		records += job->records;
+		bytes += job->size;
+		printf("%s -> %s: %lu readings", job->input, job->output, job->records);
+		if (job->chunks > 1)
+			printf(" (%d chunks)", job->chunks);
+		if (job->skipped)
+			printf(", %lu other records skipped", job->skipped);
+		if (job->tornAt >= 0)
+			printf(", %ld corrupt bytes skipped (first at offset %ld)",
+					(long)job->corruptBytes, (long)job->tornAt);
+		printf("\n");
+	}
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)/1000000.0;
+	if (seconds <= 0)
+		seconds = 1e-6;
+	printf("%d files, %lu readings, %.1f MB in %.3f s on %ld threads: %.0f readings/s, %.1f MB/s\n",
+			jobCount - failed, records, bytes/1048576.0, seconds, started ? started : 1,
+			records/seconds, bytes/1048576.0/seconds);
+	free(workers);
+	free(chunks);
+	free(jobs);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
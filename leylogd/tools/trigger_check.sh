@@ -0,0 +1,84 @@
+#!/bin/sh
+#============================================================================
+# Name        	: trigger_check.sh
+# Author      	: Christopher Ley <christopher.ley@uon.edu.au>
+# Project	   	: leylogd
+# Description 	: Hardware triggered bursts with realtime: 1, run on the unit
+# Notes		: trigger_check.sh <GPIO wired to MPL3115A2 INT1> [<leylogd>]
+#				:  As root, with leylogd.service stopped; leyld.conf is put
+#				:  back afterwards. A first run reads the current pressure,
+#				:  a second sets p_target to it with no window so that the
+#				:  reading noise keeps crossing the device threshold, with
+#				:  post_trigger: 1 so each burst ends before the next crossing.
+#				:  INT1 only rises again once the sampling thread has read
+#				:  INT_SOURCE, so the check passes when two bursts in a row
+#				:  are started by INT1 with INT_SOURCE read.
+#============================================================================
+GPIO=$1
+LEYLOGD=${2:-/usr/sbin/leylogd}
+CONF=/etc/leylogd/leyld.conf
+LOG=/var/log/leyld.log
+DATA=/var/log/leyld.csv
+WAIT_SEC=60
+
+[ -n "$GPIO" ] || { echo "Usage: $0 <gpio> [<leylogd>]"; exit 2; }
+if pidof leylogd >/dev/null; then
+	echo "leylogd is running, stop it first (systemctl stop leylogd)"
+	exit 2
+fi
+SAVED=$(mktemp /tmp/leyld.conf.XXXXXX)
+[ -f "$CONF" ] && cp "$CONF" "$SAVED"
+trap 'kill $(pidof leylogd) 2>/dev/null; if [ -s "$SAVED" ]; then cp "$SAVED" "$CONF"; else rm -f "$CONF"; fi; rm -f "$SAVED"' EXIT
+
+# Log lines written since the given line count
+newLines() {
+	tail -n +$(($1 + 1)) "$LOG"
+}
+
+stopLeylogd() {
+	kill $(pidof leylogd) 2>/dev/null
+	while pidof leylogd >/dev/null; do sleep 0.1; done
+}
+
+# 1) Current pressure, from a short real-time run
+printf 'sec: 0, usec: 200000\nrealtime: 1\ndurable: 0\n' >"$CONF"
+"$LEYLOGD" || exit 1
+sleep 2
+stopLeylogd
+PRESSURE=$(tail -n 1 "$DATA" | cut -d, -f3)
+case "$PRESSURE" in
+''|*[!0-9.]*) echo "FAIL: no MPL3115A2 pressure in $DATA"; exit 1 ;;
+esac
+
+# 2) Threshold at that pressure, hardware trigger, sampling thread on
+cat >"$CONF" <<EOF
+sec: 10, usec: 0
+realtime: 1
+durable: 0
+trigger: 1
+trigger_msec: 50
+pre_trigger: 5
+post_trigger: 1
+p_target: $PRESSURE
+p_window: 0
+trigger_gpio: $GPIO
+EOF
+START=$(wc -l <"$LOG")
+"$LEYLOGD" || exit 1
+BURSTS=0
+WAITED=0
+while [ $WAITED -lt $WAIT_SEC ] && [ $BURSTS -lt 2 ]; do
+	sleep 1
+	WAITED=$((WAITED + 1))
+	BURSTS=$(newLines $START | grep -c "Trigger: MPL3115A2 INT1 (INT_SOURCE")
+done
+stopLeylogd
+
+FAILED=0
+newLines $START | grep -q "Real-time sampling every" || { echo "FAIL: sampling thread not started"; FAILED=1; }
+newLines $START | grep -q "interrupt unavailable" && { echo "FAIL: INT1 not in use"; FAILED=1; }
+newLines $START | grep "Trigger: " | head -n 4
+echo "p_target $PRESSURE Pa: $BURSTS INT1 bursts in $WAITED s"
+[ $BURSTS -ge 2 ] || { echo "FAIL: INT1 didn't fire again after the first burst"; FAILED=1; }
+[ $FAILED -eq 0 ] && echo "trigger check passed"
+exit $FAILED